@@ -38,7 +38,6 @@
 #define ERASE_BLOCK_SIZE      NVMCTRL_ROW_SIZE
 #define FLASH_PAGE_SIZE_WORDS (int)(FLASH_PAGE_SIZE / sizeof(uint32_t))
 
-#define CONFIG_OFFSET         16128
 #define CONFIG_MAGIC          0x78656c41
 
 /*- Variables ---------------------------------------------------------------*/
@@ -58,6 +57,8 @@ void config_init(void)
     g_config.xtal_trim      = 0;
     g_config.power_count    = 0;
     g_config.brightness     = CONFIG_BRIGHTNESS_MEDIUM;
+    g_config.pll_unlocks    = 0;
+    g_config.cal_window     = CONFIG_CAL_5_MIN;
   }
 
   if (CONFIG_MAGIC != g_config.magic_2 || CONFIG_MAGIC != g_config.magic_3)
@@ -70,21 +71,98 @@ void config_init(void)
     g_config.on             = false;
     g_config.gate_time      = CONFIG_GT_1S;
     g_config.direct_freq    = CONFIG_DF_100_kHz;
+    g_config.objective      = CONFIG_OBJECTIVE_EXACT;
+    g_config.retune         = CONFIG_RETUNE_NORMAL;
+    g_config.freq_step      = CONFIG_FREQ_STEP_DIGIT;
+    g_config.fin_meter      = CONFIG_FIN_METER_OFF;
   }
 
+  if (CONFIG_MAGIC != g_config.magic_3 || CONFIG_MAGIC != g_config.magic_4)
+  {
+    g_config.magic_3        = CONFIG_MAGIC;
+    g_config.magic_4        = CONFIG_MAGIC;
+    g_config.gen_mode       = CONFIG_GEN_CONTINUOUS;
+    g_config.sweep_stop     = 10 * kHz;
+    g_config.sweep_steps    = CONFIG_SWEEP_STEPS_16;
+    g_config.sweep_dwell    = CONFIG_DWELL_100MS;
+    g_config.sweep_marker   = 0;
+    g_config.list_repeat    = CONFIG_REPEAT_LOOP;
+    g_config.burst_count    = 10;
+    g_config.burst_period   = CONFIG_DWELL_10MS;
+    g_config.burst_trigger  = CONFIG_TRIGGER_PERIOD;
+    g_config.delay_ns       = 1000;
+    g_config.width_ns       = 100;
+    g_config.dead_hs        = 4;
+    g_config.dead_ls        = 4;
+  }
+
+  if (CONFIG_MAGIC != g_config.magic_4 || CONFIG_MAGIC != g_config.magic_5)
+  {
+    g_config.magic_4        = CONFIG_MAGIC;
+    g_config.magic_5        = CONFIG_MAGIC;
+    g_config.freq_b         = 1 * MHz;
+    g_config.pattern        = 0xb4; // 0, 1, 3, 2 - quadrature
+    g_config.pattern_len    = 4;
+    g_config.wave           = CONFIG_WAVE_SINE;
+    g_config.average        = CONFIG_AVERAGE_OFF;
+  }
+
+  if (CONFIG_MAGIC != g_config.magic_5 || CONFIG_MAGIC != g_config.magic_6)
+  {
+    g_config.magic_5        = CONFIG_MAGIC;
+    g_config.magic_6        = CONFIG_MAGIC;
+    g_config.spread         = 50; // 0.5%
+    g_config.spread_rate    = 30; // kHz
+    g_config.spread_profile = CONFIG_SPREAD_CENTER;
+    g_config.period_ms      = 60000;
+    g_config.ref_input      = CONFIG_REF_OFF;
+  }
+
+  // These were added to the reserved space of existing sections, which reads
+  // as erased flash on older configurations
+  if (g_config.pll_unlocks < 0)
+    g_config.pll_unlocks = 0;
+
+  // Modes depend on the build options, a different build may have left one
+  // that is not there
+  if (g_config.mode < CONFIG_MODE_GENERATOR || g_config.mode >= CONFIG_MODE_COUNT)
+    g_config.mode = CONFIG_MODE_GENERATOR;
+
+  if (g_config.gen_mode < CONFIG_GEN_CONTINUOUS || g_config.gen_mode >= CONFIG_GEN_COUNT)
+    g_config.gen_mode = CONFIG_GEN_CONTINUOUS;
+
+  if (g_config.objective < CONFIG_OBJECTIVE_EXACT || g_config.objective > CONFIG_OBJECTIVE_BALANCED)
+    g_config.objective = CONFIG_OBJECTIVE_EXACT;
+
+  if (g_config.retune < CONFIG_RETUNE_NORMAL || g_config.retune > CONFIG_RETUNE_FAST)
+    g_config.retune = CONFIG_RETUNE_NORMAL;
+
+  if (g_config.freq_step < CONFIG_FREQ_STEP_DIGIT || g_config.freq_step > CONFIG_FREQ_STEP_EXACT)
+    g_config.freq_step = CONFIG_FREQ_STEP_DIGIT;
+
+  if (g_config.ref_input < CONFIG_REF_OFF || g_config.ref_input > CONFIG_REF_1PPS)
+    g_config.ref_input = CONFIG_REF_OFF;
+
+  if (g_config.cal_window < CONFIG_CAL_1_MIN || g_config.cal_window > CONFIG_CAL_15_MIN)
+    g_config.cal_window = CONFIG_CAL_5_MIN;
+
+  if (g_config.fin_meter < CONFIG_FIN_METER_OFF || g_config.fin_meter > CONFIG_FIN_METER_ON)
+    g_config.fin_meter = CONFIG_FIN_METER_OFF;
+
   g_config.power_count++;
 }
 
 //-----------------------------------------------------------------------------
-void config_save(void)
+void config_write_row(int offset, const void *data, int size)
 {
-  alignas(4) uint8_t data[ERASE_BLOCK_SIZE];
-  uint32_t *flash_offset = (uint32_t *)CONFIG_OFFSET;
-  uint32_t *flash_data = (uint32_t *)data;
+  alignas(4) uint8_t buf[ERASE_BLOCK_SIZE];
+  uint32_t *flash_offset = (uint32_t *)offset;
+  uint32_t *flash_data = (uint32_t *)buf;
 
-  memcpy(data, (uint8_t *)&g_config, sizeof(config_t));
+  memset(buf, 0xff, sizeof(buf));
+  memcpy(buf, data, size);
 
-  NVMCTRL->ADDR.reg = CONFIG_OFFSET >> 1;
+  NVMCTRL->ADDR.reg = offset >> 1;
 
   NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
   while (0 == NVMCTRL->INTFLAG.bit.READY);
@@ -98,4 +176,10 @@ void config_save(void)
   }
 }
 
+//-----------------------------------------------------------------------------
+void config_save(void)
+{
+  config_write_row(CONFIG_OFFSET, &g_config, sizeof(config_t));
+}
+
 
@@ -34,10 +34,19 @@
 #include <stdbool.h>
 
 /*- Definitions -------------------------------------------------------------*/
+#define CONFIG_OFFSET         16128
+#define CONFIG_LIST_OFFSET    (CONFIG_OFFSET - 2 * CONFIG_ROW_SIZE)
+#define CONFIG_TRAIN_OFFSET   (CONFIG_OFFSET - 3 * CONFIG_ROW_SIZE)
+#define CONFIG_ROW_SIZE       256
+
 enum
 {
   CONFIG_MODE_GENERATOR,
   CONFIG_MODE_COUNTER,
+#ifdef WITH_SELFTEST
+  CONFIG_MODE_SELFTEST,
+#endif
+  CONFIG_MODE_COUNT,
 };
 
 enum
@@ -57,6 +66,131 @@ enum
   CONFIG_DF_1_MHz,
 };
 
+enum
+{
+  CONFIG_REF_OFF,
+  CONFIG_REF_10_MHz,
+  CONFIG_REF_5_MHz,
+  CONFIG_REF_1_MHz,
+  CONFIG_REF_1PPS,
+};
+
+enum
+{
+  CONFIG_CAL_1_MIN,
+  CONFIG_CAL_5_MIN,
+  CONFIG_CAL_15_MIN,
+};
+
+enum
+{
+  CONFIG_OBJECTIVE_EXACT,
+  CONFIG_OBJECTIVE_LOW_JITTER,
+  CONFIG_OBJECTIVE_BALANCED,
+};
+
+enum
+{
+  CONFIG_RETUNE_NORMAL,
+  CONFIG_RETUNE_FAST,
+};
+
+enum
+{
+  CONFIG_FREQ_STEP_DIGIT,
+  CONFIG_FREQ_STEP_EXACT,
+};
+
+enum
+{
+  CONFIG_FIN_METER_OFF,
+  CONFIG_FIN_METER_ON,
+};
+
+enum
+{
+  CONFIG_AVERAGE_OFF,
+  CONFIG_AVERAGE_SIGMA_DELTA,
+};
+
+enum
+{
+  CONFIG_SPREAD_CENTER,
+  CONFIG_SPREAD_DOWN,
+};
+
+enum
+{
+  // Optional modes are selected by the build options in the Makefile
+  CONFIG_GEN_CONTINUOUS,
+#ifdef WITH_SWEEP
+  CONFIG_GEN_SWEEP_LIN,
+  CONFIG_GEN_SWEEP_LOG,
+  CONFIG_GEN_LIST,
+#endif
+#ifdef WITH_PULSE
+  CONFIG_GEN_BURST,
+  CONFIG_GEN_DELAY,
+  CONFIG_GEN_TRAIN,
+#endif
+#ifdef WITH_BRIDGE
+  CONFIG_GEN_BRIDGE,
+#endif
+#ifdef WITH_DUAL
+  CONFIG_GEN_DUAL,
+#endif
+#ifdef WITH_PATTERN
+  CONFIG_GEN_PATTERN,
+#endif
+#ifdef WITH_WAVE
+  CONFIG_GEN_WAVE,
+#endif
+#ifdef WITH_SPREAD
+  CONFIG_GEN_SPREAD,
+#endif
+#ifdef WITH_PERIOD
+  CONFIG_GEN_PERIOD,
+#endif
+  CONFIG_GEN_COUNT,
+};
+
+enum
+{
+  CONFIG_SWEEP_STEPS_8,
+  CONFIG_SWEEP_STEPS_16,
+  CONFIG_SWEEP_STEPS_32,
+  CONFIG_SWEEP_STEPS_64,
+};
+
+enum
+{
+  CONFIG_DWELL_1MS,
+  CONFIG_DWELL_10MS,
+  CONFIG_DWELL_100MS,
+  CONFIG_DWELL_1S,
+};
+
+enum
+{
+  CONFIG_REPEAT_LOOP,
+  CONFIG_REPEAT_ONCE,
+  CONFIG_REPEAT_10,
+  CONFIG_REPEAT_100,
+};
+
+enum
+{
+  CONFIG_TRIGGER_PERIOD,
+  CONFIG_TRIGGER_FIN,
+  CONFIG_TRIGGER_MANUAL,
+};
+
+enum
+{
+  CONFIG_WAVE_SINE,
+  CONFIG_WAVE_TRIANGLE,
+};
+
 enum
 {
   CONFIG_BRIGHTNESS_LOW,
@@ -70,7 +204,9 @@ typedef struct
   int      xtal_trim;
   int      power_count;
   int      brightness;
-  int      reserved_1[8];
+  int      pll_unlocks;
+  int      cal_window;
+  int      reserved_1[6];
   uint32_t magic_2;
   int      mode;
   int64_t  freq;
@@ -78,8 +214,39 @@ typedef struct
   bool     on;
   int      gate_time;
   int      direct_freq;
-  int      reserved_2[8];
+  int      objective;
+  int      retune;
+  int      freq_step;
+  int      fin_meter;
+  int      reserved_2[4];
   uint32_t magic_3;
+  int      gen_mode;
+  int64_t  sweep_stop;
+  int      sweep_steps;
+  int      sweep_dwell;
+  int      sweep_marker;
+  int      list_repeat;
+  int      burst_count;
+  int      burst_period;
+  int      burst_trigger;
+  int      delay_ns;
+  int      width_ns;
+  int      dead_hs;
+  int      dead_ls;
+  uint32_t magic_4;
+  int64_t  freq_b;
+  int      pattern;
+  int      pattern_len;
+  int      wave;
+  int      average;
+  int      reserved_4[4];
+  uint32_t magic_5;
+  int      spread;
+  int      spread_rate;
+  int      spread_profile;
+  int      period_ms;
+  int      ref_input;
+  uint32_t magic_6;
 } config_t;
 
 _Static_assert(sizeof(config_t) < 256, "Config area size is too big");
@@ -87,6 +254,7 @@ _Static_assert(sizeof(config_t) < 256, "Config area size is too big");
 /*- Prototypes --------------------------------------------------------------*/
 void config_init(void);
 void config_save(void);
+void config_write_row(int offset, const void *data, int size);
 
 /*- Variables ---------------------------------------------------------------*/
 extern config_t g_config;
@@ -35,6 +35,7 @@
 #include "ssd1306.h"
 #include "globals.h"
 #include "buttons.h"
+#include "pll.h"
 
 /*- Definitions -------------------------------------------------------------*/
 HAL_GPIO_PIN(FIN, A, 15)
@@ -45,9 +46,19 @@ HAL_GPIO_PIN(FIN, A, 15)
 
 #define SWITCH_BLOCK_TIME   3 // gate times
 
+#define REF_GATES           10    // Gate times averaged for one trim update
+#define REF_RANGE           10000 // Reference accepted within 1/REF_RANGE (100 ppm)
+
+#define CAL_OUTLIER         100   // Largest 1PPS deviation from the average, counts
+#define CAL_RESTART         4     // Rejects in a row that discard the average
+
 /*- Prototypes --------------------------------------------------------------*/
 static void update_switch_freq(void);
 static void update_pll_trim(void);
+#ifdef WITH_REF
+static void update_ref_trim(int64_t sample);
+static void counter_cal_task(void);
+#endif
 static void setup_clocks(void);
 static void setup_event_system(void);
 static void setup_gate_timer(void);
@@ -70,6 +81,14 @@ static int counter_acc_cnt = 0;
 static int64_t counter_pll_freq;
 static bool counter_trim_mode = false;
 static int counter_cursor = 0;
+#ifdef WITH_REF
+static int64_t counter_ref_acc = 0;
+static int counter_ref_cnt = 0;
+static bool counter_ref_skip = true;
+static int counter_cal_rejects = 0;
+static int counter_cal_run = 0;
+static bool counter_cal_done = false;
+#endif
 
 /*- Implementations ---------------------------------------------------------*/
 
@@ -90,6 +109,18 @@ void counter_enable(void)
   counter_acc_b = 0;
   counter_acc_a = 0;
   counter_acc_cnt = 0;
+#ifdef WITH_REF
+  counter_ref_acc = 0;
+  counter_ref_cnt = 0;
+  counter_ref_skip = true;
+  counter_cal_rejects = 0;
+  counter_cal_run = 0;
+  counter_cal_done = false;
+
+  // 1PPS edges are timestamped by the period capture of the direct mode
+  if (CONFIG_REF_1PPS == g_config.ref_input)
+    counter_gated_mode = false;
+#endif
 
   setup_clocks();
   setup_event_system();
@@ -200,6 +231,54 @@ static void update_pll_trim(void)
   TC1->COUNT32.CTRLA.bit.ENABLE = 1;
 }
 
+#ifdef WITH_REF
+//-----------------------------------------------------------------------------
+static void update_ref_trim(int64_t sample)
+{
+  static const int64_t ref_freq[] = { 0, 10000000000, 5000000000, 1000000000 };
+  int64_t ref = ref_freq[g_config.ref_input];
+  int64_t diff, trim;
+
+  // First gate after the gate timer is restarted is partial
+  if (counter_ref_skip)
+  {
+    counter_ref_skip = false;
+    return;
+  }
+
+  if (iabs(sample - ref) > ref / REF_RANGE)
+  {
+    counter_ref_acc = 0;
+    counter_ref_cnt = 0;
+    return;
+  }
+
+  counter_ref_acc += sample;
+  counter_ref_cnt++;
+
+  if (counter_ref_cnt < REF_GATES)
+    return;
+
+  // Gate is counted from the trimmed crystal, so the reference reads low by
+  // the amount the crystal runs fast
+  diff = ref * counter_ref_cnt - counter_ref_acc;
+  trim = g_config.xtal_trim + (XTAL_FREQ + g_config.xtal_trim) * diff / counter_ref_acc;
+
+  if (trim > XTAL_TRIM_MAX)
+    trim = XTAL_TRIM_MAX;
+  else if (trim < XTAL_TRIM_MIN)
+    trim = XTAL_TRIM_MIN;
+
+  g_config.xtal_trim = trim;
+
+  counter_ref_acc = 0;
+  counter_ref_cnt = 0;
+  counter_ref_skip = true;
+
+  update_pll_trim();
+}
+#endif
+
 //-----------------------------------------------------------------------------
 static void setup_clocks(void)
 {
@@ -207,14 +286,8 @@ static void setup_clocks(void)
       GCLK_GENCTRL_RUNSTDBY | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_IDC;
   while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
 
-  SYSCTRL->DPLLCTRLB.reg = SYSCTRL_DPLLCTRLB_REFCLK_REF1 | SYSCTRL_DPLLCTRLB_LBYPASS |
-      SYSCTRL_DPLLCTRLB_DIV(12 / 2 - 1); // 1 MHz reference
-  SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDR(100 - 1) | SYSCTRL_DPLLRATIO_LDRFRAC(0);
-  SYSCTRL->DPLLCTRLA.reg = SYSCTRL_DPLLCTRLA_ENABLE | SYSCTRL_DPLLCTRLA_RUNSTDBY;
-  while (0 == (SYSCTRL->DPLLSTATUS.reg & SYSCTRL_DPLLSTATUS_CLKRDY));
-  while (0 == (SYSCTRL->DPLLSTATUS.reg & SYSCTRL_DPLLSTATUS_LOCK));
-
-  SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLCKF;
+  pll_set(12, 100, 0, SYSCTRL_DPLLCTRLB_LBYPASS |
+      SYSCTRL_DPLLCTRLB_LTIME(SYSCTRL_DPLLCTRLB_LTIME_8MS_Val)); // 1 MHz reference
 }
 
 //-----------------------------------------------------------------------------
@@ -338,6 +411,23 @@ static void update_display(void)
     oled_print(3, 0, "TRIM:");
     print_freq_sign(3, 36, counter_cursor, g_config.xtal_trim);
   }
+#ifdef WITH_REF
+  else if (CONFIG_REF_1PPS == g_config.ref_input)
+  {
+    oled_set_font(SMALL);
+    oled_print(2, 0, counter_cal_done ? "CAL DONE" : "CAL 1PPS");
+    print_count(2, 60, -1, 4, counter_ref_cnt);
+    print_count(2, 96, -1, 4, counter_cal_rejects);
+    oled_print(3, 0, "REF: ");
+    print_freq_sign(3, 36, -1, g_config.xtal_trim);
+  }
+  else if (CONFIG_REF_OFF != g_config.ref_input)
+  {
+    oled_set_font(SMALL);
+    oled_print(3, 0, "REF: ");
+    print_freq_sign(3, 36, -1, g_config.xtal_trim);
+  }
+#endif
 }
 
 //-----------------------------------------------------------------------------
@@ -483,6 +573,11 @@ static void counter_gated_task(void)
     sample += 0xffffff * ovf;
     sample *= counter_gate_mult;
 
+#ifdef WITH_REF
+    if (CONFIG_REF_OFF != g_config.ref_input)
+      update_ref_trim(sample);
+#endif
+
     if (iabs(counter_freq - sample) > 10000)
     {
       counter_freq = sample;
@@ -559,12 +654,86 @@ static void counter_direct_task(void)
   }
 }
 
+#ifdef WITH_REF
+//-----------------------------------------------------------------------------
+static void counter_cal_task(void)
+{
+  static const int cal_window[] = { 60, 300, 900 };
+  int64_t period, expected;
+  int ovf;
+
+  if (0 == TCC0->INTFLAG.bit.MC0)
+    return;
+
+  TCC0->INTFLAG.reg = TCC_INTFLAG_MC0;
+
+  ovf = counter_ovf_cnt;
+  counter_ovf_cnt = 0;
+
+  // Counter restarts on every edge and wraps after PER + 1 counts
+  period = TCC0->CC[0].reg + (int64_t)0x1000000 * ovf;
+  expected = counter_pll_freq / 1000;
+  counter_freq = period ? counter_pll_freq / period : 0;
+
+  show_gate();
+
+  if (counter_cal_done)
+    return;
+
+  // Missing and extra pulses are far off the expected second, receiver
+  // glitches are far off the average of the accepted ones
+  if (iabs(period - expected) > expected / REF_RANGE || (counter_ref_cnt &&
+      iabs(period * counter_ref_cnt - counter_ref_acc) > CAL_OUTLIER * counter_ref_cnt))
+  {
+    counter_cal_rejects++;
+
+    // Average itself started from a glitch
+    if (++counter_cal_run == CAL_RESTART)
+    {
+      counter_ref_acc = 0;
+      counter_ref_cnt = 0;
+    }
+  }
+  else
+  {
+    counter_ref_acc += period;
+    counter_ref_cnt++;
+    counter_cal_run = 0;
+  }
+
+  if (counter_ref_cnt == cal_window[g_config.cal_window])
+  {
+    // DPLL runs at 100/12 of the crystal, so the average second in DPLL
+    // counts gives the crystal frequency directly
+    int64_t trim = (counter_ref_acc * 120 + counter_ref_cnt / 2) / counter_ref_cnt - XTAL_FREQ;
+
+    if (trim > XTAL_TRIM_MAX)
+      trim = XTAL_TRIM_MAX;
+    else if (trim < XTAL_TRIM_MIN)
+      trim = XTAL_TRIM_MIN;
+
+    g_config.xtal_trim = trim;
+    update_pll_trim();
+    config_save();
+
+    counter_cal_done = true;
+  }
+
+  update_display();
+}
+#endif
+
 //-----------------------------------------------------------------------------
 void counter_task(void)
 {
   update_pll_lock_indicator();
   update_gate_indicator();
 
+#ifdef WITH_REF
+  if (CONFIG_REF_1PPS == g_config.ref_input)
+    counter_cal_task();
+  else
+#endif
   if (counter_gated_mode)
     counter_gated_task();
   else
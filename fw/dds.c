@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "globals.h"
+#include "config.h"
+#include "planner.h"
+#include "generator.h"
+#include "dma.h"
+#include "dds.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define DDS_DMA_CH       0
+#define DDS_CLOCK        96000000000 // mHz
+#define DDS_RATIO        (96 * 16) // 96 MHz from 12 MHz / 12
+#define DDS_MIN_SAMPLES  16 // Per waveform cycle
+#define DDS_MIN_PER      64
+#define DDS_MAX_PER      65535 // Table values are written as half-words
+
+/*- Constants ---------------------------------------------------------------*/
+// First quarter of the sine, Q15
+static const int16_t dds_sine[65] =
+{
+      0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+   6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+  12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+  23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+  27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+  30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+  32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+  32767,
+};
+
+/*- Variables ---------------------------------------------------------------*/
+static bool dds_active = false;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+bool dds_plan(dds_plan_t *plan, int64_t freq)
+{
+  int64_t best = -1;
+
+  if (freq > DDS_MAX_FREQ)
+    return false;
+
+  // Output frequency is clock * cycles / (presc * per * samples). The table
+  // holds several cycles when that gets closer to the target, the phase
+  // accumulator does not have to wrap at the end of the table.
+  for (int samples = DDS_MAX_SAMPLES; samples >= DDS_MIN_SAMPLES; samples--)
+  {
+    for (int cycles = 1; cycles <= samples / DDS_MIN_SAMPLES; cycles++)
+    {
+      int64_t num = DDS_CLOCK * cycles;
+      int64_t ticks = num / (freq * samples);
+      int64_t error, div;
+      int presc = 0;
+      int64_t per;
+
+      while (presc < PLANNER_PRESCALERS - 1 && ticks > (int64_t)DDS_MAX_PER * planner_prescaler[presc])
+        presc++;
+
+      div = freq * samples * planner_prescaler[presc];
+      per = (num + div / 2) / div;
+
+      if (per < DDS_MIN_PER || per > DDS_MAX_PER)
+        continue;
+
+      div = per * samples * planner_prescaler[presc];
+      error = num - freq * div;
+      error = ((error < 0) ? -error : error) * 1000 / div;
+
+      if (best < 0 || error < best)
+      {
+        best = error;
+        plan->freq = num / div;
+        plan->rate = DDS_CLOCK / (planner_prescaler[presc] * per);
+        plan->presc = presc;
+        plan->per = per;
+        plan->samples = samples;
+        plan->cycles = cycles;
+      }
+    }
+  }
+
+  // The longest table at the slowest sample rate is about 5.6 mHz, well
+  // below FREQ_MIN, so only frequencies above DDS_MAX_FREQ fail
+  if (best < 0)
+    return false;
+
+  plan->bits = 0;
+
+  while ((2 << plan->bits) <= plan->per + 1)
+    plan->bits++;
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+static int dds_sample(int phase, int wave)
+{
+  int x, index, value;
+
+  // Phase is 16 bits per cycle, the result is 16 bits full scale
+  if (CONFIG_WAVE_TRIANGLE == wave)
+    return (phase < 0x8000) ? (phase * 2) : ((0xffff - phase) * 2);
+
+  x = phase & 0x3fff;
+
+  if (phase & 0x4000)
+    x = 0x4000 - x;
+
+  index = x >> 8;
+  value = dds_sine[index];
+
+  if (index < 64)
+    value += ((dds_sine[index + 1] - value) * (x & 0xff)) >> 8;
+
+  return 0x8000 + ((phase & 0x8000) ? -value : value);
+}
+
+//-----------------------------------------------------------------------------
+static uint16_t dds_value(const dds_plan_t *plan, int index, int wave)
+{
+  int phase = ((index % plan->samples) * plan->cycles * 0x10000 / plan->samples) & 0xffff;
+
+  return ((uint32_t)dds_sample(phase, wave) * plan->per) >> 16;
+}
+
+//-----------------------------------------------------------------------------
+void dds_start(const dds_plan_t *plan, int wave)
+{
+  step_t step = { .ratio = DDS_RATIO, .gendiv = 1, .output = STEP_OUTPUT_LOW };
+
+  // CCB is copied to CC on the update at the end of each period and the
+  // same overflow requests the next DMA beat, so the table starts two
+  // samples ahead of the output
+  for (int i = 0; i < plan->samples; i++)
+    g_buffer.samples[i] = dds_value(plan, i + 2, wave);
+
+  generator_apply(12, SYSCTRL_DPLLCTRLB_LBYPASS |
+      SYSCTRL_DPLLCTRLB_LTIME(SYSCTRL_DPLLCTRLB_LTIME_8MS_Val), &step);
+
+  pwm_timer_init(TCC_CTRLA_PRESCALER(plan->presc), plan->per - 1,
+      dds_value(plan, 0, wave), 0, 0);
+  TCC0->CCB[0].reg = dds_value(plan, 1, wave);
+
+  dma_loop(DDS_DMA_CH, TCC0_DMAC_ID_OVF, g_buffer.samples, plan->samples,
+      sizeof(uint16_t), &TCC0->CCB[0].reg);
+
+  TCC0->CTRLA.reg |= TCC_CTRLA_ENABLE;
+
+  generator_output(STEP_OUTPUT_TCC);
+
+  dds_active = true;
+}
+
+//-----------------------------------------------------------------------------
+void dds_stop(void)
+{
+  if (!dds_active)
+    return;
+
+  dma_stop(DDS_DMA_CH);
+
+  dds_active = false;
+}
+
+
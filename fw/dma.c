@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "dma.h"
+
+/*- Variables ---------------------------------------------------------------*/
+static DmacDescriptor dma_desc[DMA_CHANNELS] __attribute__((aligned(16)));
+static DmacDescriptor dma_wb[DMA_CHANNELS] __attribute__((aligned(16)));
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+DmacDescriptor *dma_descriptor(int ch)
+{
+  // First descriptor of a channel has a fixed place in the descriptor
+  // section, the following ones may be anywhere in RAM
+  return &dma_desc[ch];
+}
+
+//-----------------------------------------------------------------------------
+void dma_start(int ch, int trigger)
+{
+  PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+  PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+  if (0 == DMAC->CTRL.bit.DMAENABLE)
+  {
+    DMAC->BASEADDR.reg = (uint32_t)dma_desc;
+    DMAC->WRBADDR.reg = (uint32_t)dma_wb;
+    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+  }
+
+  DMAC->CHID.reg = ch;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+  while (DMAC->CHCTRLA.bit.SWRST);
+
+  // Channels without a peripheral trigger are started by their event input
+  if (trigger)
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(trigger) |
+        DMAC_CHCTRLB_TRIGACT_BEAT;
+  else
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_EVIE |
+        DMAC_CHCTRLB_EVACT_TRIG | DMAC_CHCTRLB_TRIGACT_BEAT;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE;
+}
+
+//-----------------------------------------------------------------------------
+void dma_loop(int ch, int trigger, const void *src, int count, int size, volatile void *dst)
+{
+  DmacDescriptor *desc = &dma_desc[ch];
+
+  // Descriptor links to itself, so the table is repeated until the channel
+  // is stopped. Source address points to the end of the block.
+  desc->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_SRCINC |
+      DMAC_BTCTRL_BEATSIZE(size >> 1);
+  desc->BTCNT.reg = count;
+  desc->SRCADDR.reg = (uint32_t)src + count * size;
+  desc->DSTADDR.reg = (uint32_t)dst;
+  desc->DESCADDR.reg = (uint32_t)desc;
+
+  dma_start(ch, trigger);
+}
+
+//-----------------------------------------------------------------------------
+void dma_capture(int ch, volatile const void *src, int count, int size, void *dst)
+{
+  DmacDescriptor *desc = &dma_desc[ch];
+
+  // Every event copies the current value of the source register, the channel
+  // is disabled once the buffer is full
+  desc->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_DSTINC |
+      DMAC_BTCTRL_BEATSIZE(size >> 1);
+  desc->BTCNT.reg = count;
+  desc->SRCADDR.reg = (uint32_t)src;
+  desc->DSTADDR.reg = (uint32_t)dst + count * size;
+  desc->DESCADDR.reg = 0;
+
+  dma_start(ch, 0);
+}
+
+//-----------------------------------------------------------------------------
+bool dma_done(int ch)
+{
+  DMAC->CHID.reg = ch;
+  return 0 == DMAC->CHCTRLA.bit.ENABLE;
+}
+
+//-----------------------------------------------------------------------------
+void dma_stop(int ch)
+{
+  DMAC->CHID.reg = ch;
+  DMAC->CHCTRLA.reg = 0;
+  while (DMAC->CHCTRLA.bit.ENABLE);
+}
+
+
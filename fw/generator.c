@@ -37,12 +37,19 @@
 #include "globals.h"
 #include "buttons.h"
 #include "config.h"
+#include "planner.h"
+#include "pll.h"
+#include "sequence.h"
+#include "pulse.h"
+#include "pattern.h"
+#include "dds.h"
+#include "spread.h"
+#include "meter.h"
+#include "generator.h"
 
 /*- Definitions -------------------------------------------------------------*/
 HAL_GPIO_PIN(FOUT,     A, 14)
-
-#define XTAL_FREQ      12000000000
-#define PLL_MIN_FREQ   48000000000
+HAL_GPIO_PIN(FIN,      A, 15) // Low side output in the half-bridge mode
 
 #define FREQ_MIN       100
 #define FREQ_MAX       105000000000
@@ -50,22 +57,94 @@ HAL_GPIO_PIN(FOUT,     A, 14)
 #define DC_MIN         0
 #define DC_MAX         10000
 
+#define DEAD_TIME_MAX  255
+
 enum
 {
   INPUT_FREQ,
   INPUT_ON_OFF,
   INPUT_DC,
+  INPUT_PARAM,
+  INPUT_INDEX,
   INPUT_SIZE,
 };
 
 /*- Prototypes --------------------------------------------------------------*/
 static void update_output(void);
 static void update_display(void);
+static int generator_inputs(void);
+static int input_digits(int input);
+static bool generator_list_store(void);
+
+/*- Constants ---------------------------------------------------------------*/
+static const char *objective_str[] =
+{
+  "EXACT ",
+  "LO-JIT",
+  "BAL   ",
+};
+
+#if defined(WITH_SWEEP) || defined(WITH_PULSE) || defined(WITH_BRIDGE) || defined(WITH_DUAL) || \
+    defined(WITH_PATTERN) || defined(WITH_SPREAD) || defined(WITH_PERIOD)
+static const char *mode_str[] =
+{
+  "",
+#ifdef WITH_SWEEP
+  "LIN",
+  "LOG",
+  "",
+#endif
+#ifdef WITH_PULSE
+  "PLS",
+  "WID",
+  "",
+#endif
+#ifdef WITH_BRIDGE
+  "DT",
+#endif
+#ifdef WITH_DUAL
+  "B",
+#endif
+#ifdef WITH_PATTERN
+  "PAT",
+#endif
+#ifdef WITH_WAVE
+  "",
+#endif
+#ifdef WITH_SPREAD
+  "SS",
+#endif
+#ifdef WITH_PERIOD
+  "LP",
+#endif
+};
+#endif
+
+#ifdef WITH_WAVE
+static const char *wave_str[] =
+{
+  "SIN",
+  "TRI",
+};
+#endif
 
 /*- Variables ---------------------------------------------------------------*/
-static const int input_size[INPUT_SIZE] = { 12, 1, 5 };
+generator_buffer_t g_buffer __attribute__((aligned(16)));
+static const int input_size[INPUT_SIZE] = { 12, 1, 5, 12, 1 };
 static int generator_input = 0;
 static int generator_cursor = 0;
+#ifdef WITH_SWEEP
+static list_entry_t generator_entry;
+#endif
+#ifdef WITH_PULSE
+static train_entry_t generator_train;
+#endif
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+static int generator_index = 0;
+#endif
+static bool generator_dirty = false;
+static int generator_src = GCLK_SOURCE_FDPLL;
+static bool generator_meter = false;
 
 /*- Implementations ---------------------------------------------------------*/
 
@@ -77,7 +156,7 @@ void generator_init(void)
 }
 
 //-----------------------------------------------------------------------------
-void generator_enable(void)
+void generator_clocks(void)
 {
   GCLK->GENDIV.reg = GCLK_GENDIV_ID(4) | GCLK_GENDIV_DIV(0);
 
@@ -86,20 +165,100 @@ void generator_enable(void)
       GCLK_GENCTRL_IDC;
   while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
 
+  generator_src = GCLK_SOURCE_FDPLL;
+
   PM->APBCMASK.reg |= PM_APBCMASK_TCC0;
 
   GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TCC0 | GCLK_CLKCTRL_CLKEN |
       GCLK_CLKCTRL_GEN(4);
+}
+
+//-----------------------------------------------------------------------------
+void generator_enable(void)
+{
+  generator_clocks();
+
+  if (generator_input >= generator_inputs() ||
+      generator_cursor >= input_digits(generator_input))
+  {
+    generator_input = INPUT_FREQ;
+    generator_cursor = 0;
+  }
+
+#ifdef WITH_SWEEP
+  if (CONFIG_GEN_LIST == g_config.gen_mode)
+  {
+    generator_index %= LIST_MAX_STEPS;
+    sequence_list_load(generator_index, &generator_entry);
+  }
+#endif
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+    pulse_train_load(generator_index, &generator_train);
+#endif
 
   oled_set_font(SMALL);
-  oled_putc(0, 0, 'F');
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_DELAY == g_config.gen_mode)
+    oled_putc(0, 0, 'D');
+  else
+#endif
+#ifdef WITH_PERIOD
+  if (CONFIG_GEN_PERIOD == g_config.gen_mode)
+    oled_putc(0, 0, 'P');
+  else
+#endif
+    oled_putc(0, 0, 'F');
+
+#ifdef WITH_METER
+  // Continuous output leaves TC1, the RTC and FIN free, so the meter runs
+  // next to the generator. The counter itself needs TCC0, GCLK4 and the
+  // DPLL, which the output uses.
+  generator_meter = (CONFIG_GEN_CONTINUOUS == g_config.gen_mode &&
+      CONFIG_FIN_METER_ON == g_config.fin_meter);
+
+  if (generator_meter)
+    meter_start();
+#endif
+
   update_display();
   update_output();
 }
 
+//-----------------------------------------------------------------------------
+static void generator_stop(void)
+{
+#ifdef WITH_SWEEP
+  sequence_stop();
+#endif
+#ifdef WITH_PULSE
+  pulse_stop();
+#endif
+#ifdef WITH_PATTERN
+  pattern_stop();
+#endif
+#ifdef WITH_WAVE
+  dds_stop();
+#endif
+#ifdef WITH_SPREAD
+  spread_stop();
+#endif
+}
+
 //-----------------------------------------------------------------------------
 void generator_disable(void)
 {
+  generator_list_store();
+  generator_stop();
+
+#ifdef WITH_METER
+  if (generator_meter)
+  {
+    meter_stop();
+    generator_meter = false;
+  }
+#endif
+
   GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TCC0 | GCLK_CLKCTRL_CLKEN |
       GCLK_CLKCTRL_GEN(0);
 
@@ -109,170 +268,511 @@ void generator_disable(void)
   GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(4);
   while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
 
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(5);
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
   SYSCTRL->DPLLCTRLA.reg = 0;
 
   HAL_GPIO_FOUT_pmuxdis();
   HAL_GPIO_FOUT_clr();
+  HAL_GPIO_FIN_pmuxdis();
 }
 
 //-----------------------------------------------------------------------------
-static void pll_set(int div, int ldr, int ldrfrac)
-{
-  SYSCTRL->DPLLCTRLA.reg = 0;
-  SYSCTRL->DPLLCTRLB.reg = SYSCTRL_DPLLCTRLB_REFCLK_REF1 | SYSCTRL_DPLLCTRLB_LBYPASS |
-      SYSCTRL_DPLLCTRLB_DIV(div / 2 - 1);
-  SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDR(ldr - 1) | SYSCTRL_DPLLRATIO_LDRFRAC(ldrfrac);
-  SYSCTRL->DPLLCTRLA.reg = SYSCTRL_DPLLCTRLA_ENABLE | SYSCTRL_DPLLCTRLA_RUNSTDBY;
-  while (0 == (SYSCTRL->DPLLSTATUS.reg & SYSCTRL_DPLLSTATUS_CLKRDY));
-  while (0 == (SYSCTRL->DPLLSTATUS.reg & SYSCTRL_DPLLSTATUS_LOCK));
-
-  SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLCKF;
-}
-
-//-----------------------------------------------------------------------------
-static void pwm_timer_set(int div, int per, int cc)
+void pwm_timer_init(int ctrla, int per, int cc, int wave, int evctrl)
 { 
   TCC0->CTRLA.reg = TCC_CTRLA_SWRST;
   while (TCC0->SYNCBUSY.bit.SWRST);
 
-  TCC0->CTRLA.reg = TCC_CTRLA_PRESCALER(div) | TCC_CTRLA_PRESCSYNC_PRESC;
-  TCC0->WAVE.reg = TCC_WAVE_WAVEGEN_NPWM;
+  TCC0->CTRLA.reg = ctrla | TCC_CTRLA_PRESCSYNC_PRESC;
+  TCC0->WAVE.reg = TCC_WAVE_WAVEGEN_NPWM | wave;
+  TCC0->EVCTRL.reg = evctrl;
 
   TCC0->COUNT.reg = 0;
   TCC0->PER.reg = per;
   TCC0->CC[0].reg = cc;
+}
+
+//-----------------------------------------------------------------------------
+void pwm_timer_set(int ctrla, int per, int cc, int wave, int evctrl)
+{
+  pwm_timer_init(ctrla, per, cc, wave, evctrl);
+  TCC0->CTRLA.reg |= TCC_CTRLA_ENABLE;
+}
+
+//-----------------------------------------------------------------------------
+void generator_output(int output)
+{
+  if (STEP_OUTPUT_GCLK == output)
+  {
+    HAL_GPIO_FOUT_pmuxen(PORT_PMUX_PMUXE_H_Val);
+  }
+  else if (STEP_OUTPUT_TCC == output)
+  {
+    HAL_GPIO_FOUT_pmuxen(PORT_PMUX_PMUXE_F_Val);
+  }
+  else
+  {
+    HAL_GPIO_FOUT_write(STEP_OUTPUT_HIGH == output);
+    HAL_GPIO_FOUT_pmuxdis();
+  }
+}
+
+//-----------------------------------------------------------------------------
+int pwm_timer_ctrla(int presc, bool dith)
+{
+  return TCC_CTRLA_PRESCALER(presc) | (dith ? TCC_CTRLA_RESOLUTION_DITH6 : 0);
+}
+
+//-----------------------------------------------------------------------------
+int pwm_timer_top(int per, bool dith)
+{
+  // Dithered period keeps the cycle count in the low bits and the top value
+  // in the high bits
+  return per - (dith ? DITHER_STEPS : 1);
+}
+
+//-----------------------------------------------------------------------------
+static void generator_dividers(const step_t *step, bool buffered)
+{
+  int ctrla = pwm_timer_ctrla(step->presc, step->dith);
+  int top = pwm_timer_top(step->per, step->dith);
+
+  GCLK->GENDIV.reg = GCLK_GENDIV_ID(4) | GCLK_GENDIV_DIV(step->gendiv);
+
+  if (STEP_OUTPUT_TCC == step->output)
+  {
+    if (buffered && TCC0->CTRLA.bit.ENABLE && (uint32_t)ctrla ==
+        (TCC0->CTRLA.reg & (TCC_CTRLA_PRESCALER_Msk | TCC_CTRLA_RESOLUTION_Msk)))
+    {
+      // New period starts at the end of the current one, so there are no
+      // partial or missing pulses at the step boundary
+      TCC0->PERB.reg = top;
+      TCC0->CCB[0].reg = step->cc;
+    }
+    else
+    {
+      pwm_timer_set(ctrla, top, step->cc, 0, 0);
+    }
+  }
+
+  generator_output(step->output);
+}
+
+//-----------------------------------------------------------------------------
+void generator_step(const step_t *step)
+{
+  pll_retune(step->ratio);
+  generator_dividers(step, true);
+}
+
+//-----------------------------------------------------------------------------
+static void generator_source(int src)
+{
+  if (src == generator_src)
+    return;
+
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(4) | GCLK_GENCTRL_SRC(src) |
+      GCLK_GENCTRL_RUNSTDBY | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_OE |
+      GCLK_GENCTRL_IDC;
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
+  generator_src = src;
+}
+
+//-----------------------------------------------------------------------------
+void generator_apply(int rdiv, int ctrlb, const step_t *step)
+{
+  if (0 == step->ratio)
+  {
+    // Exact divisions of the crystal need no DPLL, there is no lock to wait
+    // for and no fractional-N jitter
+    generator_source(GCLK_SOURCE_XOSC);
+    SYSCTRL->DPLLCTRLA.reg = 0;
+    while (SYSCTRL->DPLLSTATUS.reg & SYSCTRL_DPLLSTATUS_ENABLE);
+
+    // Disabling the DPLL drops the lock, which is not a loss of lock
+    SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLCKF;
+  }
+  else
+  {
+    // DPLL is locked before it is switched in, so no off-frequency edges
+    // reach the output
+    pll_set(rdiv, step->ratio / 16, step->ratio % 16, ctrlb);
+    generator_source(GCLK_SOURCE_FDPLL);
+  }
+
+  generator_dividers(step, false);
+}
+
+#ifdef WITH_BRIDGE
+//-----------------------------------------------------------------------------
+static bool generator_bridge(const plan_t *plan)
+{
+  int hs = g_config.dead_hs;
+  int ls = g_config.dead_ls;
+  int scale = plan->dith ? DITHER_STEPS : 1;
+  int offset = 0;
+  int dead_hs, dead_ls;
+
+  if (0 == plan->per)
+    return false;
+
+  // Both outputs are high side outputs of the dead-time generators, so DTHS
+  // applies to both. Channel 1 is the inverted copy of channel 0, shifted to
+  // make up the difference to the low side dead time. Prescaled periods
+  // are long compared to the dead times, both sides use the longer one.
+  if (plan->presc)
+  {
+    hs = (hs > ls) ? hs : ls;
+    dead_hs = dead_ls = (hs + planner_prescaler[plan->presc] - 1) / planner_prescaler[plan->presc] * scale;
+  }
+  else
+  {
+    offset = (ls - hs) * scale;
+    dead_hs = hs * scale;
+    dead_ls = ls * scale;
+  }
+
+  // Dead times are in GCLK cycles, the compare values in timer counts. Each
+  // side has to stay on for longer than its dead time and the shifted edge
+  // has to stay within the period.
+  if (dead_hs > plan->cc || dead_ls > plan->per - plan->cc ||
+      plan->cc + offset < 0 || plan->cc + offset > pwm_timer_top(plan->per, plan->dith))
+    return false;
+
+  pwm_timer_init(pwm_timer_ctrla(plan->presc, plan->dith),
+      pwm_timer_top(plan->per, plan->dith), plan->cc, TCC_WAVE_POL1, 0);
+
+  TCC0->WEXCTRL.reg = TCC_WEXCTRL_OTMX(0) | TCC_WEXCTRL_DTIEN0 | TCC_WEXCTRL_DTIEN1 |
+      TCC_WEXCTRL_DTHS(hs);
+  TCC0->CC[1].reg = plan->cc + offset;
 
   TCC0->CTRLA.reg |= TCC_CTRLA_ENABLE;
+
+  // FOUT is WO[4] and FIN is WO[5]
+  generator_output(STEP_OUTPUT_TCC);
+  HAL_GPIO_FIN_pmuxen(PORT_PMUX_PMUXE_F_Val);
+
+  return true;
 }
+#endif
+
+#ifdef WITH_DUAL
+//-----------------------------------------------------------------------------
+static bool generator_dual(void)
+{
+  plan_t plan;
+  step_t step;
+  int div_b;
+
+  if (g_config.freq < JOINT_MIN_FREQ || g_config.freq > JOINT_MAX_FREQ ||
+      g_config.freq_b < JOINT_MIN_FREQ || g_config.freq_b > JOINT_MAX_FREQ)
+    return false;
+
+  div_b = planner_joint(&plan, g_config.freq, g_config.freq_b);
+
+  if (0 == div_b)
+    return false;
+
+  planner_pack(&step, &plan);
+  generator_apply(plan.rdiv, plan.ctrlb, &step);
+
+  // Second output is GCLK5 on FIN (GCLK_IO[5]) from the same DPLL
+  GCLK->GENDIV.reg = GCLK_GENDIV_ID(5) | GCLK_GENDIV_DIV(div_b);
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(5) | GCLK_GENCTRL_SRC_FDPLL |
+      GCLK_GENCTRL_RUNSTDBY | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_OE |
+      GCLK_GENCTRL_IDC;
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
+  HAL_GPIO_FIN_pmuxen(PORT_PMUX_PMUXE_H_Val);
+
+  return true;
+}
+#endif
 
 //-----------------------------------------------------------------------------
 static void update_output(void)
 {
-  int64_t pll_int, pll_frac, set_freq;
-  int64_t pll_freq = g_config.freq;
-  int64_t div = 1;
-  int pll_div;
-  int64_t min_rem;
-  int64_t min_step = 0;
-  int64_t min_ref = 0;
-  bool min_high = false;
-  int min_rdiv = 0;
-  int set_dc;
+  plan_t plan;
+  step_t step;
+
+  generator_stop();
 
   HAL_GPIO_FOUT_pmuxdis();
 
+  // FIN stays on the EIC while the meter counts it
+  if (!generator_meter)
+    HAL_GPIO_FIN_pmuxdis();
+
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(5);
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
   oled_set_font(SMALL);
 
   if (!g_config.on)
   {
-    print_freq(3, 0, -1, 0);
-    print_dc(3, 92, -1, 0);
+    oled_print(2, 30, "         ");
+
+    if (CONFIG_GEN_CONTINUOUS == g_config.gen_mode)
+    {
+      print_freq(3, 0, -1, 0);
+      print_dc(3, 92, -1, 0);
+    }
+#ifdef WITH_WAVE
+    else if (CONFIG_GEN_WAVE == g_config.gen_mode)
+    {
+      print_freq(3, 0, -1, 0);
+    }
+#endif
+
     return;
   }
 
-  while (pll_freq < PLL_MIN_FREQ)
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_DELAY == g_config.gen_mode)
   {
-    pll_freq *= 2;
-    div *= 2;
+    pulse_delay();
+    oled_print(2, 30, "DELAY   ");
+    return;
   }
 
-  min_rem = pll_freq;
+  if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+  {
+    oled_print(2, 30, pulse_train() ? "TRAIN   " : "EMPTY   ");
+    return;
+  }
+#endif
 
-  for (int rdiv = 8; rdiv < 376; rdiv += 2) // Ensures 32 kHz - 1 MHz PLL input frequency range
+#ifdef WITH_DUAL
+  if (CONFIG_GEN_DUAL == g_config.gen_mode)
   {
-    int64_t ref = (XTAL_FREQ + g_config.xtal_trim) / rdiv;
-    int64_t step = ref / 16;
-    int64_t rem = pll_freq % step;
+    oled_print(2, 30, generator_dual() ? "DUAL    " : "RANGE   ");
+    return;
+  }
+#endif
 
-    if (rem < min_rem)
+#ifdef WITH_PERIOD
+  if (CONFIG_GEN_PERIOD == g_config.gen_mode)
+  {
+    if (g_config.period_ms < PERIOD_MIN_MS || g_config.period_ms > PERIOD_MAX_MS)
     {
-      min_rem = rem;
-      min_rdiv = rdiv;
-      min_step = step;
-      min_ref = ref;
-      min_high = false;
+      oled_print(2, 30, "RANGE   ");
+      return;
     }
 
-    if ((step - rem) < min_rem)
+    planner_period(&plan, g_config.period_ms, g_config.dc);
+    planner_pack(&step, &plan);
+    generator_apply(plan.rdiv, plan.ctrlb, &step);
+
+    oled_print(2, 30, "PERIOD  ");
+    return;
+  }
+#endif
+
+#ifdef WITH_WAVE
+  if (CONFIG_GEN_WAVE == g_config.gen_mode)
+  {
+    dds_plan_t dds;
+
+    // Resolution in bits of the duty and the sample rate of the table
+    if (dds_plan(&dds, g_config.freq))
+    {
+      dds_start(&dds, g_config.wave);
+      print_count(2, 30, -1, 2, dds.bits);
+      oled_print(2, 42, " BIT  ");
+      print_freq(3, 0, -1, dds.rate);
+    }
+    else
     {
-      min_rem = step - rem;
-      min_rdiv = rdiv;
-      min_step = step;
-      min_ref = ref;
-      min_high = true;
+      oled_print(2, 30, "TOO FAST");
+      print_freq(3, 0, -1, 0);
     }
 
-    if (0 == rem)
-      break;
+    return;
   }
+#endif
 
-  pll_div = pll_freq  / min_step;
+#ifdef WITH_SWEEP
+  if (CONFIG_GEN_SWEEP_LIN == g_config.gen_mode || CONFIG_GEN_SWEEP_LOG == g_config.gen_mode ||
+      CONFIG_GEN_LIST == g_config.gen_mode)
+  {
+    oled_print(2, 30, sequence_run() ? "RUN     " : "EMPTY   ");
+    return;
+  }
+#endif
 
-  if (min_high)
-    pll_div += 1;
+#ifdef WITH_SPREAD
+  // Spread spectrum modulates the DPLL ratio, so it always needs the DPLL
+  // and a reference divider fine enough for the spread
+  if (CONFIG_GEN_SPREAD == g_config.gen_mode)
+  {
+    spread_plan(&plan, g_config.freq, g_config.dc);
+    planner_pack(&step, &plan);
+    generator_apply(plan.rdiv, plan.ctrlb, &step);
 
-  pll_int = pll_div / 16;
-  pll_frac = pll_div % 16;
-  set_freq = (min_ref * pll_int + min_ref * pll_frac / 16) / div;
+    oled_print(2, 30, spread_start(&plan) ? "SPREAD  " : "RANGE   ");
+    return;
+  }
+#endif
 
-  pll_set(min_rdiv, pll_int, pll_frac);
+  planner_search(&plan, g_config.freq, g_config.dc);
+  planner_direct(&plan, g_config.freq, g_config.dc);
+  planner_pack(&step, &plan);
 
-  if (div <= 2)
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_BURST == g_config.gen_mode)
   {
-    GCLK->GENDIV.reg = GCLK_GENDIV_ID(4) | GCLK_GENDIV_DIV(div);
-    HAL_GPIO_FOUT_pmuxen(PORT_PMUX_PMUXE_H_Val);
+    // Pulse timer is started by the burst engine once the events are routed
+    step.output = STEP_OUTPUT_LOW;
+    generator_apply(plan.rdiv, plan.ctrlb, &step);
 
-    if (g_config.dc < 3333)
-      set_dc = 0;
-    else if (g_config.dc > 6666)
-      set_dc = 10000;
-    else
-      set_dc = 5000;
+    oled_print(2, 30, pulse_burst(&plan) ? "BURST   " : "TOO FAST");
+    return;
   }
-  else
-  {
-    int timer_div = div;
-    int timer_presc = 0;
-    int64_t cc;
+#endif
 
-    GCLK->GENDIV.reg = GCLK_GENDIV_ID(4) | GCLK_GENDIV_DIV(0);
+#ifdef WITH_BRIDGE
+  if (CONFIG_GEN_BRIDGE == g_config.gen_mode)
+  {
+    // Output pins are connected once the timer is running
+    step.output = STEP_OUTPUT_LOW;
+    generator_apply(plan.rdiv, plan.ctrlb, &step);
 
-    while (timer_div > (1 << 24))
-    {
-      timer_div /= 2;
-      timer_presc++;
-    }
+    oled_print(2, 30, generator_bridge(&plan) ? "BRIDGE  " : "TOO FAST");
+    return;
+  }
+#endif
 
-    cc = ((int64_t)g_config.dc * timer_div + 5000) / 10000;
-    set_dc = (cc * 10000 + timer_div / 2) / timer_div;
+#ifdef WITH_PATTERN
+  if (CONFIG_GEN_PATTERN == g_config.gen_mode)
+  {
+    // Output pins are connected once the timer is running
+    step.output = STEP_OUTPUT_LOW;
+    generator_apply(plan.rdiv, plan.ctrlb, &step);
 
-    pwm_timer_set(timer_presc, timer_div - 1, cc);
-    HAL_GPIO_FOUT_pmuxen(PORT_PMUX_PMUXE_F_Val);
+    oled_print(2, 30, pattern_start(&plan) ? "PATTERN " : "TOO FAST");
+    return;
   }
+#endif
+
+  generator_apply(plan.rdiv, plan.ctrlb, &step);
 
-  if (0 == set_dc)
+#ifdef WITH_METER
+  if (generator_meter)
   {
-    HAL_GPIO_FOUT_clr();
-    HAL_GPIO_FOUT_pmuxdis();
+    // FIN reading takes the place of the plan flags, the gate in progress
+    // spans the output change
+    oled_print(2, 30, "         ");
+    meter_arm();
   }
-  else if (10000 == set_dc)
+  else
+#endif
   {
-    HAL_GPIO_FOUT_set();
-    HAL_GPIO_FOUT_pmuxdis();
+    oled_print(2, 30, (char *)objective_str[g_config.objective]);
+    oled_putc(2, 72, (0 == plan.rdiv) ? 'X' : plan.ldrfrac ? 'F' : 'I');
+    oled_putc(2, 78, plan.dith ? 'D' : ' ');
   }
 
-  print_freq(3, 0, -1, set_freq);
-  print_dc(3, 92, -1, set_dc);
+#ifdef WITH_SWEEP
+  // Averaging modulator needs TC1, which is taken by the meter
+  if (CONFIG_AVERAGE_SIGMA_DELTA == g_config.average && plan.error && !generator_meter)
+  {
+    int frac, ratio = planner_average(&plan, g_config.freq, &frac);
+
+    // Remaining error is below the modulator resolution otherwise
+    if (frac)
+    {
+      sequence_average(ratio, frac);
+      oled_putc(2, 72, 'A');
+      plan.freq = g_config.freq;
+    }
+  }
+#endif
+
+  print_freq(3, 0, -1, plan.freq);
+  print_dc(3, 92, -1, plan.dc);
 }
 
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+//-----------------------------------------------------------------------------
+static void print_index(void)
+{
+  char buf[4] = { '#', '0' + (generator_index + 1) / 10, '0' + (generator_index + 1) % 10, 0 };
+
+  oled_set_inverted(INPUT_INDEX == generator_input);
+  oled_print(3, 104, buf);
+  oled_set_inverted(false);
+}
+#endif
+
 //-----------------------------------------------------------------------------
 static void update_display(void)
 {
-  oled_set_font(BIG);
-  print_freq(0, 16, (INPUT_FREQ == generator_input) ? generator_cursor : -1, g_config.freq);
+  int param = (INPUT_PARAM == generator_input) ? generator_cursor : -1;
+  int cursor = (INPUT_FREQ == generator_input) ? generator_cursor : -1;
 
-  oled_set_font(SMALL);
-  print_dc(2, 92, (INPUT_DC == generator_input) ? generator_cursor : -1, g_config.dc);
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_DELAY == g_config.gen_mode)
+  {
+    oled_set_font(BIG);
+    print_count(0, 16, cursor, 9, g_config.delay_ns);
+
+    oled_set_font(SMALL);
+    oled_print(1, 110, "ns");
+    print_count(3, 0, param, 9, g_config.width_ns);
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+  else if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+  {
+    oled_set_font(BIG);
+    print_count(0, 16, cursor, 9, generator_train.period);
+
+    oled_set_font(SMALL);
+    oled_print(1, 110, "ns");
+    print_count(2, 80, (INPUT_DC == generator_input) ? generator_cursor : -1, 5,
+        generator_train.repeat);
+    oled_print(2, 116, "x");
+  }
+  else
+#endif
+#ifdef WITH_PERIOD
+  if (CONFIG_GEN_PERIOD == g_config.gen_mode)
+  {
+    oled_set_font(BIG);
+    print_count(0, 16, cursor, 9, g_config.period_ms);
+
+    oled_set_font(SMALL);
+    oled_print(1, 110, "ms");
+    print_dc(2, 92, (INPUT_DC == generator_input) ? generator_cursor : -1, g_config.dc);
+
+    // Frequency in uHz, the mHz display has no digits left at these periods
+    print_count(3, 0, -1, 10, (g_config.period_ms > 0) ? 1000000000 / g_config.period_ms : 0);
+    oled_print(3, 72, "uHz");
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+  else
+#endif
+  {
+    int64_t freq = g_config.freq;
+    int dc = g_config.dc;
+
+#ifdef WITH_SWEEP
+    if (CONFIG_GEN_LIST == g_config.gen_mode)
+    {
+      freq = generator_entry.freq;
+      dc = generator_entry.dc;
+    }
+#endif
+
+    oled_set_font(BIG);
+    print_freq(0, 16, cursor, freq);
+
+    oled_set_font(SMALL);
+
+    if (input_digits(INPUT_DC))
+      print_dc(2, 92, (INPUT_DC == generator_input) ? generator_cursor : -1, dc);
+  }
 
   oled_set_inverted(INPUT_ON_OFF == generator_input);
   oled_print(2, 0, "    ");
@@ -283,6 +783,245 @@ static void update_display(void)
     oled_print(2, 4, "OFF");
 
   oled_set_inverted(false);
+
+#ifdef WITH_SWEEP
+  // Dwell in ms, shown as seconds
+  if (CONFIG_GEN_LIST == g_config.gen_mode)
+  {
+    print_freq(3, 0, param, generator_entry.dwell);
+    print_index();
+  }
+  else if (CONFIG_GEN_SWEEP_LIN == g_config.gen_mode || CONFIG_GEN_SWEEP_LOG == g_config.gen_mode)
+  {
+    print_freq(3, 0, param, g_config.sweep_stop);
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+#endif
+
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+  {
+    print_count(3, 0, param, 9, generator_train.width);
+    print_index();
+  }
+  else if (CONFIG_GEN_BURST == g_config.gen_mode)
+  {
+    print_count(3, 0, param, 5, g_config.burst_count);
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+#endif
+
+#ifdef WITH_PATTERN
+  if (CONFIG_GEN_PATTERN == g_config.gen_mode)
+  {
+    char buf[2] = { 0, 0 };
+
+    // Steps are shown left to right, the cursor counts from the last one
+    for (int i = 0; i < PATTERN_MAX_STEPS; i++)
+    {
+      buf[0] = (i < g_config.pattern_len) ? '0' + pattern_get(i) : ' ';
+      oled_set_inverted(param >= 0 && i == g_config.pattern_len - 1 - param);
+      oled_print(3, i * 6, buf);
+    }
+
+    oled_set_inverted(false);
+    print_count(3, 60, (INPUT_INDEX == generator_input) ? generator_cursor : -1, 1, g_config.pattern_len);
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+#endif
+
+#ifdef WITH_WAVE
+  if (CONFIG_GEN_WAVE == g_config.gen_mode)
+  {
+    oled_set_inverted(INPUT_PARAM == generator_input);
+    oled_print(3, 104, (char *)wave_str[g_config.wave]);
+    oled_set_inverted(false);
+  }
+#endif
+
+#ifdef WITH_SPREAD
+  if (CONFIG_GEN_SPREAD == g_config.gen_mode)
+  {
+    // Spread in 0.01% and the modulation rate in kHz
+    print_dc(3, 0, param, g_config.spread);
+    oled_print(3, 42, "%");
+    print_count(3, 54, (INPUT_INDEX == generator_input) ? generator_cursor : -1, 3, g_config.spread_rate);
+    oled_print(3, 72, "kHz");
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+#endif
+
+#ifdef WITH_BRIDGE
+  if (CONFIG_GEN_BRIDGE == g_config.gen_mode)
+  {
+    // Dead times in GCLK4 counts
+    oled_print(3, 0, "H");
+    print_count(3, 8, param, 3, g_config.dead_hs);
+    oled_print(3, 40, "L");
+    print_count(3, 48, (INPUT_INDEX == generator_input) ? generator_cursor : -1, 3, g_config.dead_ls);
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+#endif
+
+#ifdef WITH_DUAL
+  if (CONFIG_GEN_DUAL == g_config.gen_mode)
+  {
+    print_freq(3, 0, param, g_config.freq_b);
+    oled_print(3, 104, (char *)mode_str[g_config.gen_mode]);
+  }
+#endif
+
+  (void)param;
+}
+
+//-----------------------------------------------------------------------------
+static int generator_inputs(void)
+{
+  int inputs = INPUT_PARAM;
+
+  // Stop frequency and dwell are only edited in the sequence modes, the
+  // second parameter or the entry index only in some of them
+#ifdef WITH_SWEEP
+  if (CONFIG_GEN_SWEEP_LIN == g_config.gen_mode || CONFIG_GEN_SWEEP_LOG == g_config.gen_mode)
+    inputs = INPUT_INDEX;
+  else if (CONFIG_GEN_LIST == g_config.gen_mode)
+    inputs = INPUT_SIZE;
+#endif
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+    inputs = INPUT_SIZE;
+  else if (CONFIG_GEN_BURST == g_config.gen_mode || CONFIG_GEN_DELAY == g_config.gen_mode)
+    inputs = INPUT_INDEX;
+#endif
+#ifdef WITH_BRIDGE
+  if (CONFIG_GEN_BRIDGE == g_config.gen_mode)
+    inputs = INPUT_SIZE;
+#endif
+#ifdef WITH_DUAL
+  if (CONFIG_GEN_DUAL == g_config.gen_mode)
+    inputs = INPUT_INDEX;
+#endif
+#ifdef WITH_PATTERN
+  if (CONFIG_GEN_PATTERN == g_config.gen_mode)
+    inputs = INPUT_SIZE;
+#endif
+#ifdef WITH_WAVE
+  if (CONFIG_GEN_WAVE == g_config.gen_mode)
+    inputs = INPUT_INDEX;
+#endif
+#ifdef WITH_SPREAD
+  if (CONFIG_GEN_SPREAD == g_config.gen_mode)
+    inputs = INPUT_SIZE;
+#endif
+#ifdef WITH_PERIOD
+  if (CONFIG_GEN_PERIOD == g_config.gen_mode)
+    inputs = INPUT_INDEX;
+#endif
+
+  return inputs;
+}
+
+//-----------------------------------------------------------------------------
+static int input_digits(int input)
+{
+#ifdef WITH_DUAL
+  if (INPUT_DC == input && CONFIG_GEN_DUAL == g_config.gen_mode)
+    return 0; // Skipped, both clocks are at 50%
+#endif
+
+#ifdef WITH_WAVE
+  if (CONFIG_GEN_WAVE == g_config.gen_mode)
+  {
+    if (INPUT_DC == input)
+      return 0; // Skipped, the duty cycle is the output value
+    else if (INPUT_PARAM == input)
+      return 1;
+  }
+#endif
+
+#ifdef WITH_PATTERN
+  if (CONFIG_GEN_PATTERN == g_config.gen_mode)
+  {
+    if (INPUT_DC == input)
+      return 0; // Skipped, the pattern sets the output levels
+    else if (INPUT_PARAM == input)
+      return g_config.pattern_len;
+    else if (INPUT_INDEX == input)
+      return 1;
+  }
+#endif
+
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+  {
+    if (INPUT_DC == input)
+      return 5; // Repeat count
+    else if (INPUT_FREQ == input || INPUT_PARAM == input)
+      return 9;
+  }
+
+  if (CONFIG_GEN_DELAY == g_config.gen_mode)
+  {
+    if (INPUT_DC == input)
+      return 0; // Skipped, the pulse has no duty cycle
+    else if (INPUT_ON_OFF != input)
+      return 9;
+  }
+
+  if (INPUT_PARAM == input && CONFIG_GEN_BURST == g_config.gen_mode)
+    return 5;
+#endif
+
+#ifdef WITH_PERIOD
+  if (CONFIG_GEN_PERIOD == g_config.gen_mode)
+  {
+    if (INPUT_FREQ == input)
+      return 9;
+    else if (INPUT_PARAM == input)
+      return 0; // Skipped, the frequency is only shown
+  }
+#endif
+
+#ifdef WITH_BRIDGE
+  if (INPUT_PARAM <= input && CONFIG_GEN_BRIDGE == g_config.gen_mode)
+    return 3;
+#endif
+
+#ifdef WITH_SPREAD
+  if (INPUT_PARAM <= input && CONFIG_GEN_SPREAD == g_config.gen_mode)
+    return 3;
+#endif
+
+  return input_size[input];
+}
+
+//-----------------------------------------------------------------------------
+static bool generator_list_store(void)
+{
+  if (!generator_dirty)
+    return false;
+
+#ifdef WITH_PULSE
+  if (CONFIG_GEN_TRAIN == g_config.gen_mode)
+    pulse_train_store(generator_index, &generator_train);
+#endif
+#ifdef WITH_SWEEP
+  if (CONFIG_GEN_LIST == g_config.gen_mode)
+    sequence_list_store(generator_index, &generator_entry);
+#endif
+
+  generator_dirty = false;
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+static int64_t input_adjust(int64_t value, int64_t step, int64_t min, int64_t max)
+{
+  if ((value + step) < min || (value + step) > max)
+    return value;
+
+  return value + step;
 }
 
 //-----------------------------------------------------------------------------
@@ -297,76 +1036,183 @@ void generator_buttons_event(int button, int event, int interval)
     {
       generator_cursor--;
 
-      if (generator_cursor < 0)
+      while (generator_cursor < 0)
       {
         generator_input++;
 
-        if (generator_input == INPUT_SIZE)
+        if (generator_input == generator_inputs())
           generator_input = 0;
 
-        generator_cursor = input_size[generator_input] - 1;
+        generator_cursor = input_digits(generator_input) - 1;
       }
     }
     else if (BUTTON_LEFT == button)
     {
       generator_cursor++;
 
-      if (generator_cursor == input_size[generator_input])
+      while (generator_cursor >= input_digits(generator_input))
       {
         generator_input--;
 
         if (generator_input < 0)
-          generator_input = INPUT_SIZE - 1;
+          generator_input = generator_inputs() - 1;
 
         generator_cursor = 0;
       }
     }
-
-    if (INPUT_FREQ == generator_input)
+    else if (BUTTON_UP == button || BUTTON_DOWN == button)
     {
-      int64_t step = ipow(10, generator_cursor);
+      int dir = (BUTTON_UP == button) ? 1 : -1;
+      int64_t step = dir * ipow(10, generator_cursor);
+      bool changed = true;
 
-      if (BUTTON_UP == button)
+      if (INPUT_ON_OFF == generator_input)
       {
-        if (g_config.freq <= (FREQ_MAX - step))
-          g_config.freq += step;
-
-        update_output();
+#ifdef WITH_PULSE
+        // Up fires the next burst, Down switches the output off
+        if (g_config.on && BUTTON_UP == button && CONFIG_GEN_BURST == g_config.gen_mode &&
+            CONFIG_TRIGGER_MANUAL == g_config.burst_trigger)
+        {
+          pulse_fire();
+          changed = false;
+        }
+        else
+#endif
+        {
+          generator_list_store();
+          g_config.on = !g_config.on;
+        }
       }
-      else if (BUTTON_DOWN == button)
+#ifdef WITH_PULSE
+      else if (INPUT_INDEX == generator_input && CONFIG_GEN_TRAIN == g_config.gen_mode)
       {
-        if (g_config.freq >= (FREQ_MIN + step))
-          g_config.freq -= step;
-
-        update_output();
+        changed = generator_list_store();
+        generator_index = (generator_index + TRAIN_MAX_STEPS + dir) % TRAIN_MAX_STEPS;
+        pulse_train_load(generator_index, &generator_train);
       }
-    }
-    else if (INPUT_ON_OFF == generator_input)
-    {
-      if (BUTTON_UP == button || BUTTON_DOWN == button)
+      else if (CONFIG_GEN_TRAIN == g_config.gen_mode)
       {
-        g_config.on = !g_config.on;
-        update_output();
+        // Train entries are stored when another entry is selected or the
+        // output is switched, the high time may exceed a shortened period
+        if (INPUT_FREQ == generator_input)
+          generator_train.period = input_adjust(generator_train.period, step, TRAIN_MIN_NS, TRAIN_MAX_NS);
+        else if (INPUT_DC == generator_input)
+          generator_train.repeat = input_adjust(generator_train.repeat, step, 0, TRAIN_MAX_REPEAT);
+        else
+          generator_train.width = input_adjust(generator_train.width, step, 0, TRAIN_MAX_NS);
+
+        generator_dirty = true;
+        changed = false;
       }
-    }
-    else if (INPUT_DC == generator_input)
-    {
-      int step = ipow(10, generator_cursor);
-
-      if (BUTTON_UP == button)
+      else if (CONFIG_GEN_DELAY == g_config.gen_mode)
+      {
+        // Delay and width share the 24 bit timer period
+        if (INPUT_FREQ == generator_input)
+          g_config.delay_ns = input_adjust(g_config.delay_ns, step, PULSE_STEP_NS, PULSE_MAX_NS - g_config.width_ns);
+        else
+          g_config.width_ns = input_adjust(g_config.width_ns, step, PULSE_STEP_NS, PULSE_MAX_NS - g_config.delay_ns);
+      }
+#endif
+#ifdef WITH_SWEEP
+      else if (INPUT_INDEX == generator_input && CONFIG_GEN_LIST == g_config.gen_mode)
+      {
+        changed = generator_list_store();
+        generator_index = (generator_index + LIST_MAX_STEPS + dir) % LIST_MAX_STEPS;
+        sequence_list_load(generator_index, &generator_entry);
+      }
+      else if (CONFIG_GEN_LIST == g_config.gen_mode)
+      {
+        // List entries are stored and resolved when another entry is
+        // selected or the output is switched
+        if (INPUT_FREQ == generator_input)
+          generator_entry.freq = input_adjust(generator_entry.freq, step, FREQ_MIN, FREQ_MAX);
+        else if (INPUT_DC == generator_input)
+          generator_entry.dc = input_adjust(generator_entry.dc, step, DC_MIN, DC_MAX);
+        else
+          generator_entry.dwell = input_adjust(generator_entry.dwell, step, 0, LIST_DWELL_MAX);
+
+        generator_dirty = true;
+        changed = false;
+      }
+#endif
+#ifdef WITH_PERIOD
+      else if (CONFIG_GEN_PERIOD == g_config.gen_mode && INPUT_FREQ == generator_input)
+      {
+        g_config.period_ms = input_adjust(g_config.period_ms, step, PERIOD_MIN_MS, PERIOD_MAX_MS);
+      }
+#endif
+#ifdef WITH_NEAREST
+      else if (INPUT_FREQ == generator_input && CONFIG_FREQ_STEP_EXACT == g_config.freq_step)
+      {
+        // Jump to the next frequency the planner can hit with no error
+        g_config.freq = input_adjust(g_config.freq, planner_nearest(g_config.freq, dir) -
+            g_config.freq, FREQ_MIN, FREQ_MAX);
+      }
+#endif
+      else if (INPUT_FREQ == generator_input)
+      {
+        g_config.freq = input_adjust(g_config.freq, step, FREQ_MIN, FREQ_MAX);
+      }
+      else if (INPUT_DC == generator_input)
       {
-        if (g_config.dc <= (DC_MAX - step))
-          g_config.dc += step;
+        g_config.dc = input_adjust(g_config.dc, step, DC_MIN, DC_MAX);
+      }
+#ifdef WITH_WAVE
+      else if (CONFIG_GEN_WAVE == g_config.gen_mode)
+      {
+        g_config.wave = (CONFIG_WAVE_SINE == g_config.wave) ? CONFIG_WAVE_TRIANGLE : CONFIG_WAVE_SINE;
+      }
+#endif
+#ifdef WITH_PATTERN
+      else if (CONFIG_GEN_PATTERN == g_config.gen_mode)
+      {
+        int index = g_config.pattern_len - 1 - generator_cursor;
 
-        update_output();
+        if (INPUT_PARAM == generator_input)
+          pattern_set(index, pattern_get(index) + dir);
+        else
+          g_config.pattern_len = input_adjust(g_config.pattern_len, dir, 1, PATTERN_MAX_STEPS);
+      }
+#endif
+#ifdef WITH_SPREAD
+      else if (CONFIG_GEN_SPREAD == g_config.gen_mode)
+      {
+        if (INPUT_PARAM == generator_input)
+          g_config.spread = input_adjust(g_config.spread, step, SPREAD_MIN, SPREAD_MAX);
+        else
+          g_config.spread_rate = input_adjust(g_config.spread_rate, step, SPREAD_MIN_RATE, SPREAD_MAX_RATE);
+      }
+#endif
+#ifdef WITH_BRIDGE
+      else if (CONFIG_GEN_BRIDGE == g_config.gen_mode)
+      {
+        if (INPUT_PARAM == generator_input)
+          g_config.dead_hs = input_adjust(g_config.dead_hs, step, 0, DEAD_TIME_MAX);
+        else
+          g_config.dead_ls = input_adjust(g_config.dead_ls, step, 0, DEAD_TIME_MAX);
+      }
+#endif
+#ifdef WITH_PULSE
+      else if (CONFIG_GEN_BURST == g_config.gen_mode)
+      {
+        g_config.burst_count = input_adjust(g_config.burst_count, step, 1, BURST_MAX_COUNT);
+      }
+#endif
+#ifdef WITH_DUAL
+      else if (CONFIG_GEN_DUAL == g_config.gen_mode)
+      {
+        g_config.freq_b = input_adjust(g_config.freq_b, step, JOINT_MIN_FREQ, JOINT_MAX_FREQ);
       }
-      else if (BUTTON_DOWN == button)
+#endif
+#ifdef WITH_SWEEP
+      else
       {
-        if (g_config.dc >= (DC_MIN + step))
-          g_config.dc -= step;
+        g_config.sweep_stop = input_adjust(g_config.sweep_stop, step, FREQ_MIN, FREQ_MAX);
+      }
+#endif
 
+      if (changed)
         update_output();
-      }
     }
   }
 
@@ -379,6 +1225,19 @@ void generator_buttons_event(int button, int event, int interval)
 void generator_task(void)
 {
   update_pll_lock_indicator();
+
+#ifdef WITH_METER
+  int64_t freq;
+
+  // FIN frequency in Hz, the 1 s gate has no finer resolution
+  if (generator_meter && meter_read(&freq))
+  {
+    oled_set_font(SMALL);
+    print_count(2, 30, -1, 8, freq / 1000);
+
+    meter_arm();
+  }
+#endif
 }
 
 
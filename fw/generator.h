@@ -29,12 +29,49 @@
 #ifndef _GENERATOR_H_
 #define _GENERATOR_H_
 
+/*- Includes ----------------------------------------------------------------*/
+#include "samd11.h"
+#include "planner.h"
+#include "sequence.h"
+#include "dds.h"
+#include "spread.h"
+#include "pattern.h"
+#include "pulse.h"
+
+/*- Types -------------------------------------------------------------------*/
+// Only one generator mode runs at a time, so their tables share the memory
+typedef union
+{
+  step_t   steps[SEQUENCE_MAX_STEPS];
+  uint16_t samples[DDS_MAX_SAMPLES];
+  uint32_t spread[SPREAD_MAX_STEPS];
+  uint16_t pattern[PATTERN_MAX_STEPS];
+
+  struct
+  {
+    DmacDescriptor desc[2][TRAIN_MAX_STEPS + 1];
+    uint32_t value[2][TRAIN_MAX_STEPS + 1];
+    int      repeat[TRAIN_MAX_STEPS + 1];
+  } train;
+} generator_buffer_t;
+
+/*- Variables ---------------------------------------------------------------*/
+extern generator_buffer_t g_buffer;
+
 /*- Prototypes --------------------------------------------------------------*/
 void generator_init(void);
+void generator_clocks(void);
 void generator_enable(void);
 void generator_disable(void);
 void generator_buttons_event(int button, int event, int interval);
 void generator_task(void);
+void generator_output(int output);
+void generator_step(const step_t *step);
+void generator_apply(int rdiv, int ctrlb, const step_t *step);
+int pwm_timer_ctrla(int presc, bool dith);
+int pwm_timer_top(int per, bool dith);
+void pwm_timer_init(int ctrla, int per, int cc, int wave, int evctrl);
+void pwm_timer_set(int ctrla, int per, int cc, int wave, int evctrl);
 
 #endif // _GENERATOR_H_
 
@@ -46,6 +46,7 @@
 
 /*- Prototypes --------------------------------------------------------------*/
 int get_system_time(void);
+uint32_t get_system_time_us(void);
 void sleep_ms(int ms);
 int battery_read(void);
 void power_off(void);
@@ -63,6 +64,7 @@ int iitoa(char *buf, int value, int decimal, int sign);
 void print_freq(int line, int x, int cursor, int64_t freq);
 void print_freq_sign(int line, int x, int cursor, int64_t freq);
 void print_dc(int line, int x, int cursor, int dc);
+void print_count(int line, int x, int cursor, int size, int count);
 
 #endif // _GLOBALS_H_
 
@@ -40,6 +40,8 @@
 #include "menu.h"
 #include "counter.h"
 #include "generator.h"
+#include "selftest.h"
+#include "pll.h"
 
 /*- Definitions -------------------------------------------------------------*/
 HAL_GPIO_PIN(PWR, A, 2)
@@ -153,6 +155,20 @@ int get_system_time(void)
   return t2;
 }
 
+//-----------------------------------------------------------------------------
+uint32_t get_system_time_us(void)
+{
+  int ms, val;
+
+  do
+  {
+    ms = app_system_time;
+    val = SysTick->VAL;
+  } while (ms != app_system_time);
+
+  return (uint32_t)ms * 1000 + (SysTick->LOAD - val) / (F_CPU / 1000000ul);
+}
+
 //-----------------------------------------------------------------------------
 void sleep_ms(int ms)
 {
@@ -208,12 +224,9 @@ void update_pll_lock_indicator(void)
 {
   static int off_time = 0;
   int time = get_system_time();
-  bool unlocked = SYSCTRL->INTFLAG.bit.DPLLLCKF;
 
-  if (unlocked)
+  if (pll_unlocked())
   {
-    SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLCKF;
-
     oled_set_font(SMALL);
     oled_putc(0, 8, 'U');
     off_time = time + 500;
@@ -383,11 +396,21 @@ void print_dc(int line, int x, int cursor, int dc)
   fmt_print_helper(line, x, cursor, 5, 2, false, dc);
 }
 
+//-----------------------------------------------------------------------------
+void print_count(int line, int x, int cursor, int size, int count)
+{
+  fmt_print_helper(line, x, cursor, size, 0, false, count);
+}
+
 //-----------------------------------------------------------------------------
 void set_menu_mode(void)
 {
   if (CONFIG_MODE_GENERATOR == g_config.mode)
     generator_disable();
+#ifdef WITH_SELFTEST
+  else if (CONFIG_MODE_SELFTEST == g_config.mode)
+    selftest_disable();
+#endif
   else
     counter_disable();
 
@@ -406,6 +429,10 @@ void set_operation_mode(void)
 
   if (CONFIG_MODE_GENERATOR == g_config.mode)
     generator_enable();
+#ifdef WITH_SELFTEST
+  else if (CONFIG_MODE_SELFTEST == g_config.mode)
+    selftest_enable();
+#endif
   else
     counter_enable();
 }
@@ -417,6 +444,10 @@ void buttons_event(int button, int event, int interval)
     menu_buttons_event(button, event, interval);
   else if (CONFIG_MODE_GENERATOR == g_config.mode)
     generator_buttons_event(button, event, interval);
+#ifdef WITH_SELFTEST
+  else if (CONFIG_MODE_SELFTEST == g_config.mode)
+    selftest_buttons_event(button, event, interval);
+#endif
   else
     counter_buttons_event(button, event, interval);
 }
@@ -428,6 +459,7 @@ int main(void)
   config_init();
   battery_init();
   system_time_init();
+  pll_init();
   buttons_init();
   oled_init();
   update_display_brightness();
@@ -450,6 +482,10 @@ int main(void)
 
       if (CONFIG_MODE_GENERATOR == g_config.mode)
         generator_task();
+#ifdef WITH_SELFTEST
+      else if (CONFIG_MODE_SELFTEST == g_config.mode)
+        selftest_task();
+#endif
       else
         counter_task();
     }
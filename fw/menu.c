@@ -35,6 +35,8 @@
 #include "buttons.h"
 #include "ssd1306.h"
 #include "config.h"
+#include "planner.h"
+#include "pll.h"
 
 /*- Definitions -------------------------------------------------------------*/
 #define DISPLAY_LINES          4
@@ -69,6 +71,43 @@ static const char *operating_mode_str[] =
 {
   "Generator",
   "Counter / Meter",
+#ifdef WITH_SELFTEST
+  "Self Test",
+#endif
+  NULL
+};
+
+static const char *generator_mode_str[] =
+{
+  "Continuous",
+#ifdef WITH_SWEEP
+  "Linear Sweep",
+  "Log Sweep",
+  "Step List",
+#endif
+#ifdef WITH_PULSE
+  "Burst",
+  "Pulse Delay",
+  "Pulse Train",
+#endif
+#ifdef WITH_BRIDGE
+  "Half Bridge",
+#endif
+#ifdef WITH_DUAL
+  "Dual Clock",
+#endif
+#ifdef WITH_PATTERN
+  "Pattern",
+#endif
+#ifdef WITH_WAVE
+  "Waveform",
+#endif
+#ifdef WITH_SPREAD
+  "Spread Spectrum",
+#endif
+#ifdef WITH_PERIOD
+  "Long Period",
+#endif
   NULL
 };
 
@@ -100,6 +139,58 @@ static const char *preset_dc_str[] =
   NULL
 };
 
+#ifdef WITH_SWEEP
+static const char *sweep_steps_str[] =
+{
+  "8 steps",
+  "16 steps",
+  "32 steps",
+  "64 steps",
+  NULL
+};
+#endif
+
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+static const char *interval_str[] =
+{
+  "1 ms",
+  "10 ms",
+  "100 ms",
+  "1 second",
+  NULL
+};
+#endif
+
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+static const char *list_repeat_str[] =
+{
+  "Loop",
+  "Once",
+  "10 times",
+  "100 times",
+  NULL
+};
+#endif
+
+#ifdef WITH_PULSE
+static const char *burst_trigger_str[] =
+{
+  "Period",
+  "FIN Rising Edge",
+  "Manual",
+  NULL
+};
+#endif
+
+#ifdef WITH_SWEEP
+static const char *start_marker_str[] =
+{
+  "Off",
+  "On FIN Pin",
+  NULL
+};
+#endif
+
 static const char *gate_time_str[] =
 {
   "0.1 second",
@@ -119,6 +210,79 @@ static const char *direct_freq_str[] =
   NULL
 };
 
+#ifdef WITH_REF
+static const char *ref_input_str[] =
+{
+  "Off",
+  "10 MHz",
+  "5 MHz",
+  "1 MHz",
+  "GPS 1PPS",
+  NULL
+};
+#endif
+
+#ifdef WITH_REF
+static const char *cal_window_str[] =
+{
+  "1 minute",
+  "5 minutes",
+  "15 minutes",
+  NULL
+};
+#endif
+
+static const char *plan_objective_str[] =
+{
+  "Exact",
+  "Low Jitter",
+  "Balanced",
+  NULL
+};
+
+static const char *retune_str[] =
+{
+  "Normal",
+  "Fast Retune",
+  NULL
+};
+
+#ifdef WITH_NEAREST
+static const char *freq_step_str[] =
+{
+  "Digit",
+  "Next Exact",
+  NULL
+};
+#endif
+
+#ifdef WITH_SWEEP
+static const char *average_str[] =
+{
+  "Off",
+  "Sigma-Delta",
+  NULL
+};
+#endif
+
+#ifdef WITH_METER
+static const char *fin_meter_str[] =
+{
+  "Off",
+  "On",
+  NULL
+};
+#endif
+
+#ifdef WITH_SPREAD
+static const char *spread_profile_str[] =
+{
+  "Center",
+  "Down",
+  NULL
+};
+#endif
+
 static const char *display_brightness_str[] =
 {
   "Low",
@@ -130,11 +294,48 @@ static const char *display_brightness_str[] =
 enum
 {
   MENU_ITEM_OPERATING_MODE,
+  MENU_ITEM_GENERATOR_MODE,
   MENU_ITEM_PRESET_FREQUENCY,
   MENU_ITEM_PRESET_DC,
+#ifdef WITH_SWEEP
+  MENU_ITEM_SWEEP_STEPS,
+  MENU_ITEM_SWEEP_DWELL,
+#endif
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+  MENU_ITEM_LIST_REPEAT,
+#endif
+#ifdef WITH_SWEEP
+  MENU_ITEM_START_MARKER,
+#endif
+#ifdef WITH_PULSE
+  MENU_ITEM_BURST_PERIOD,
+  MENU_ITEM_BURST_TRIGGER,
+#endif
+#ifdef WITH_SPREAD
+  MENU_ITEM_SPREAD_PROFILE,
+#endif
   MENU_ITEM_GATE_TIME,
   MENU_ITEM_DIRECT_THRESHOLD,
+#ifdef WITH_REF
+  MENU_ITEM_REF_INPUT,
+  MENU_ITEM_CAL_WINDOW,
+#endif
+  MENU_ITEM_PLAN_OBJECTIVE,
+  MENU_ITEM_RETUNE,
+#ifdef WITH_NEAREST
+  MENU_ITEM_FREQ_STEP,
+#endif
+#ifdef WITH_SWEEP
+  MENU_ITEM_AVERAGE,
+#endif
+#ifdef WITH_METER
+  MENU_ITEM_FIN_METER,
+#endif
   MENU_ITEM_DISPLAY_BRIGHTNESS,
+#ifdef WITH_STATS
+  MENU_ITEM_PLAN_INFORMATION,
+  MENU_ITEM_PLL_STATISTICS,
+#endif
   MENU_ITEM_SYSTEM_INFORMATION,
   MENU_ITEM_POWER_OFF,
 };
@@ -142,11 +343,48 @@ enum
 static const char *main_menu_str[] =
 {
   "Operating Mode",
+  "Generator Mode",
   "Preset Frequency",
   "Preset Duty Cycle",
+#ifdef WITH_SWEEP
+  "Sweep Steps",
+  "Sweep Dwell",
+#endif
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+  "List Repeat",
+#endif
+#ifdef WITH_SWEEP
+  "Start Marker",
+#endif
+#ifdef WITH_PULSE
+  "Burst Period",
+  "Burst Trigger",
+#endif
+#ifdef WITH_SPREAD
+  "Spread Profile",
+#endif
   "Gate Time",
   "Direct Frequency",
+#ifdef WITH_REF
+  "Reference Input",
+  "Calibration Window",
+#endif
+  "Plan Objective",
+  "Retune Preference",
+#ifdef WITH_NEAREST
+  "Frequency Step",
+#endif
+#ifdef WITH_SWEEP
+  "Frequency Averaging",
+#endif
+#ifdef WITH_METER
+  "FIN Meter",
+#endif
   "Display Brightness",
+#ifdef WITH_STATS
+  "Plan Information",
+  "PLL Statistics",
+#endif
   "System Information",
   "Power Off",
   NULL
@@ -155,11 +393,48 @@ static const char *main_menu_str[] =
 static const menu_items_t menu_items[] =
 {
   { operating_mode_str, &g_config.mode },
+  { generator_mode_str, &g_config.gen_mode },
   { preset_freq_str, NULL },
   { preset_dc_str, NULL },
+#ifdef WITH_SWEEP
+  { sweep_steps_str, &g_config.sweep_steps },
+  { interval_str, &g_config.sweep_dwell },
+#endif
+#if defined(WITH_SWEEP) || defined(WITH_PULSE)
+  { list_repeat_str, &g_config.list_repeat },
+#endif
+#ifdef WITH_SWEEP
+  { start_marker_str, &g_config.sweep_marker },
+#endif
+#ifdef WITH_PULSE
+  { interval_str, &g_config.burst_period },
+  { burst_trigger_str, &g_config.burst_trigger },
+#endif
+#ifdef WITH_SPREAD
+  { spread_profile_str, &g_config.spread_profile },
+#endif
   { gate_time_str, &g_config.gate_time },
   { direct_freq_str, &g_config.direct_freq },
+#ifdef WITH_REF
+  { ref_input_str, &g_config.ref_input },
+  { cal_window_str, &g_config.cal_window },
+#endif
+  { plan_objective_str, &g_config.objective },
+  { retune_str, &g_config.retune },
+#ifdef WITH_NEAREST
+  { freq_step_str, &g_config.freq_step },
+#endif
+#ifdef WITH_SWEEP
+  { average_str, &g_config.average },
+#endif
+#ifdef WITH_METER
+  { fin_meter_str, &g_config.fin_meter },
+#endif
   { display_brightness_str, &g_config.brightness },
+#ifdef WITH_STATS
+  { NULL, NULL },
+  { NULL, NULL },
+#endif
   { NULL, NULL },
   { NULL, NULL },
 };
@@ -174,6 +449,10 @@ static int menu_main_cursor;
 static int menu_main_offset;
 static bool menu_static;
 static int menu_power_off_time;
+#ifdef WITH_STATS
+static int menu_pll_page;
+static int menu_plan_page;
+#endif
 
 /*- Implementations ---------------------------------------------------------*/
 
@@ -288,6 +567,138 @@ static void menu_power_off(void)
   power_off();
 }
 
+#ifdef WITH_STATS
+//-----------------------------------------------------------------------------
+static void menu_plan_information(void)
+{
+  plan_t plan, legacy;
+
+  planner_search(&plan, g_config.freq, g_config.dc);
+
+#ifdef WITH_DUAL
+  // Dual output shares the DPLL, its error covers both outputs
+  if (CONFIG_GEN_DUAL == g_config.gen_mode)
+    planner_joint(&plan, g_config.freq, g_config.freq_b);
+  else
+#endif
+#ifdef WITH_SPREAD
+  if (CONFIG_GEN_SPREAD != g_config.gen_mode)
+#endif
+    planner_direct(&plan, g_config.freq, g_config.dc);
+
+  oled_clear_screen();
+
+  if (0 == menu_plan_page)
+  {
+    planner_legacy(&legacy, g_config.freq, g_config.dc);
+
+    oled_print(0, 0, "F");
+    oled_print(1, 0, plan.rdiv ? "PLL" : "XO");
+    oled_print(2, 0, "Err");
+    oled_print(3, 0, "Old");
+
+    print_freq(0, 18, -1, plan.freq);
+    print_freq(1, 18, -1, plan.pll_freq);
+    print_freq(2, 18, -1, plan.error);
+    print_freq(3, 18, -1, legacy.error);
+
+    oled_print(0, 110, "Hz");
+    oled_print(1, 110, "Hz");
+    oled_print(2, 110, "mHz");
+    oled_print(3, 110, "mHz");
+  }
+  else
+  {
+    // Duty steps depend on the output period in timer counts, direct GCLK
+    // output only has 50% duty
+    oled_print(0, 0, "Duty    :");
+    oled_print(1, 0, "Step    :");
+    oled_print(2, 0, "Output  :");
+
+    print_dc(0, 60, -1, plan.dc);
+    print_dc(1, 60, -1, plan.dc_step);
+    oled_print(0, 110, "%");
+    oled_print(1, 110, "%");
+
+    if (0 == plan.per)
+      oled_print(2, 60, "GCLK");
+    else
+      oled_print(2, 60, plan.dith ? "TCC DITH" : "TCC");
+  }
+}
+
+//-----------------------------------------------------------------------------
+static void menu_pll_statistics(void)
+{
+  char buf[12];
+
+  oled_clear_screen();
+
+  if (0 == menu_pll_page)
+  {
+    oled_print(0, 0, "Unlocks :");
+    oled_print(1, 0, "Last    :");
+    oled_print(2, 0, "Timeouts:");
+    oled_print(3, 0, "Retunes :");
+
+    iitoa(buf, g_config.pll_unlocks, 0, 0);
+    oled_print(0, 60, buf);
+
+    if (pll_last_unlock() < 0)
+    {
+      oled_print(1, 60, "never");
+    }
+    else
+    {
+      int size = iitoa(buf, pll_last_unlock() / 1000, 0, 0);
+      oled_print(1, 60, buf);
+      oled_print(1, 60 + size * 6, "s");
+    }
+
+    iitoa(buf, pll_timeouts(), 0, 0);
+    oled_print(2, 60, buf);
+
+    iitoa(buf, pll_retunes(), 0, 0);
+    oled_print(3, 60, buf);
+  }
+  else
+  {
+    const pll_stats_t *stats = pll_slot_stats(menu_pll_page - 1);
+    int size;
+
+    if (0 == stats->rdiv)
+    {
+      oled_print(0, 0, "Not used");
+      return;
+    }
+
+    // Statistics are kept per reference divider of the 12 MHz XOSC
+    oled_print(0, 0, "Rdiv");
+    iitoa(buf, stats->rdiv, 0, 0);
+    oled_print(0, 30, buf);
+
+    size = iitoa(buf, 12000 / stats->rdiv, 0, 0);
+    oled_print(0, 60, buf);
+    oled_print(0, 60 + size * 6, "kHz");
+
+    oled_print(1, 0, "ms");
+    oled_print(1, 38, "Min");
+    oled_print(1, 74, "Avg");
+    oled_print(1, 110, "Max");
+
+    oled_print(2, 0, "Rdy");
+    print_dc(2, 20, -1, stats->ready_min / 10);
+    print_dc(2, 56, -1, stats->ready_avg / 10);
+    print_dc(2, 92, -1, stats->ready_max / 10);
+
+    oled_print(3, 0, "Lck");
+    print_dc(3, 20, -1, stats->lock_min / 10);
+    print_dc(3, 56, -1, stats->lock_avg / 10);
+    print_dc(3, 92, -1, stats->lock_max / 10);
+  }
+}
+#endif
+
 //-----------------------------------------------------------------------------
 void menu_buttons_event(int button, int event, int interval)
 {
@@ -296,6 +707,22 @@ void menu_buttons_event(int button, int event, int interval)
 
   if (menu_static)
   {
+#ifdef WITH_STATS
+    if (BUTTON_PRESSED == event && MENU_ITEM_PLL_STATISTICS == index &&
+        (BUTTON_UP == button || BUTTON_DOWN == button))
+    {
+      menu_pll_page += (BUTTON_UP == button) ? PLL_SLOTS : 1;
+      menu_pll_page %= (PLL_SLOTS + 1);
+      menu_pll_statistics();
+    }
+    else if (BUTTON_PRESSED == event && MENU_ITEM_PLAN_INFORMATION == index &&
+        (BUTTON_UP == button || BUTTON_DOWN == button))
+    {
+      menu_plan_page ^= 1;
+      menu_plan_information();
+    }
+    else
+#endif
     if (BUTTON_PRESSED == event)
     {
       menu_static = false;
@@ -423,6 +850,26 @@ static void menu_main_action(int index)
 
     menu_static = true;
   }
+#ifdef WITH_STATS
+  else if (MENU_ITEM_PLAN_INFORMATION == index)
+  {
+    menu_plan_page = 0;
+    menu_plan_information();
+
+    sleep_ms(200);
+
+    menu_static = true;
+  }
+  else if (MENU_ITEM_PLL_STATISTICS == index)
+  {
+    menu_pll_page = 0;
+    menu_pll_statistics();
+
+    sleep_ms(200);
+
+    menu_static = true;
+  }
+#endif
   else if (MENU_ITEM_POWER_OFF == index)
   {
     menu_power_off();
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "hal_gpio.h"
+#include "config.h"
+#include "dma.h"
+#include "meter.h"
+
+/*- Definitions -------------------------------------------------------------*/
+HAL_GPIO_PIN(FIN, A, 15)
+
+#define XTAL_FREQ      12000000000
+
+#define GATE_GCLK      1
+#define GATE_TICKS     1000000 // 1 s of the 1 MHz crystal clock
+#define GATE_DMA_CH    2
+
+/*- Variables ---------------------------------------------------------------*/
+static volatile uint32_t meter_capture[2];
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+void meter_start(void)
+{
+  PM->APBAMASK.reg |= PM_APBAMASK_RTC | PM_APBAMASK_EIC;
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS | PM_APBCMASK_TC1 | PM_APBCMASK_TC2;
+
+  // Gate is timed from the crystal, so the DPLL stays with the generator
+  GCLK->GENDIV.reg = GCLK_GENDIV_ID(GATE_GCLK) | GCLK_GENDIV_DIV(12);
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(GATE_GCLK) | GCLK_GENCTRL_SRC_XOSC |
+      GCLK_GENCTRL_RUNSTDBY | GCLK_GENCTRL_GENEN;
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_RTC | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(GATE_GCLK);
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TC1_TC2 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(0);
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EIC | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(0);
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EVSYS_1 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(0);
+
+  RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_SWRST;
+  while (RTC->MODE0.STATUS.bit.SYNCBUSY);
+
+  RTC->MODE0.COMP[0].reg = GATE_TICKS - 1;
+  RTC->MODE0.EVCTRL.reg = RTC_MODE0_EVCTRL_CMPEO0;
+  RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_MATCHCLR |
+      RTC_MODE0_CTRL_PRESCALER_DIV1 | RTC_MODE0_CTRL_ENABLE;
+  while (RTC->MODE0.STATUS.bit.SYNCBUSY);
+
+  // Edge counter is never stopped, the count is read continuously, so the
+  // DMA takes a snapshot at the end of every gate
+  TC1->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC1->COUNT32.CTRLA.bit.SWRST);
+
+  TC1->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_PRESCSYNC_GCLK;
+  TC1->COUNT32.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_COUNT;
+  TC1->COUNT32.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(0x10/*COUNT*/);
+  TC1->COUNT32.CTRLA.bit.ENABLE = 1;
+
+  HAL_GPIO_FIN_in();
+  HAL_GPIO_FIN_pmuxen(PORT_PMUX_PMUXE_A_Val);
+
+  EIC->CONFIG[0].reg = EIC_CONFIG_SENSE1_RISE;
+  EIC->EVCTRL.reg = EIC_EVCTRL_EXTINTEO1;
+  EIC->CTRL.bit.ENABLE = 1;
+
+  EVSYS->USER.reg = EVSYS_USER_USER(0x0a/*TC1_EVU*/) | EVSYS_USER_CHANNEL(0+1);
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(0) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS |
+      EVSYS_CHANNEL_EDGSEL_RISING_EDGE | EVSYS_CHANNEL_EVGEN(0x0d/*EIC_EXTINT1*/);
+
+  EVSYS->USER.reg = EVSYS_USER_USER(0x02/*DMAC_CH2*/) | EVSYS_USER_CHANNEL(1+1);
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(1) | EVSYS_CHANNEL_PATH_RESYNCHRONIZED |
+      EVSYS_CHANNEL_EDGSEL_RISING_EDGE | EVSYS_CHANNEL_EVGEN(0x01/*RTC_CMP0*/);
+}
+
+//-----------------------------------------------------------------------------
+void meter_stop(void)
+{
+  dma_stop(GATE_DMA_CH);
+
+  EIC->CTRL.reg = EIC_CTRL_SWRST;
+  while (EIC->STATUS.bit.SYNCBUSY);
+
+  RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_SWRST;
+  while (RTC->MODE0.STATUS.bit.SYNCBUSY);
+
+  TC1->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC1->COUNT32.CTRLA.bit.SWRST);
+
+  EVSYS->CTRL.reg = EVSYS_CTRL_SWRST;
+
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(GATE_GCLK);
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
+  HAL_GPIO_FIN_pmuxdis();
+}
+
+//-----------------------------------------------------------------------------
+void meter_arm(void)
+{
+  // Two gate ends, the edge count between them covers exactly one gate
+  dma_capture(GATE_DMA_CH, &TC1->COUNT32.COUNT.reg, 2, sizeof(uint32_t),
+      (void *)meter_capture);
+}
+
+//-----------------------------------------------------------------------------
+bool meter_read(int64_t *freq)
+{
+  if (!dma_done(GATE_DMA_CH))
+    return false;
+
+  // Gate clock is the trimmed crystal divided by 12
+  *freq = (int64_t)(meter_capture[1] - meter_capture[0]) *
+      ((XTAL_FREQ + g_config.xtal_trim) / 12) / GATE_TICKS;
+
+  return true;
+}
+
+
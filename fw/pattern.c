@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "hal_gpio.h"
+#include "globals.h"
+#include "config.h"
+#include "planner.h"
+#include "generator.h"
+#include "dma.h"
+#include "pattern.h"
+
+/*- Definitions -------------------------------------------------------------*/
+HAL_GPIO_PIN(FIN,      A, 15)
+
+#define PATTERN_DMA_CH   0
+
+/*- Variables ---------------------------------------------------------------*/
+static bool pattern_active = false;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+int pattern_get(int index)
+{
+  return (g_config.pattern >> (index * 2)) & 3;
+}
+
+//-----------------------------------------------------------------------------
+void pattern_set(int index, int value)
+{
+  g_config.pattern &= ~(3 << (index * 2));
+  g_config.pattern |= (value & 3) << (index * 2);
+}
+
+//-----------------------------------------------------------------------------
+static uint16_t pattern_value(int index)
+{
+  int value = pattern_get(index % g_config.pattern_len);
+
+  // Bit 0 of a step drives FOUT (WO[4]), bit 1 drives FIN (WO[5])
+  return TCC_PATT_PGE4 | TCC_PATT_PGE5 | ((value & 1) ? TCC_PATT_PGV4 : 0) |
+      ((value & 2) ? TCC_PATT_PGV5 : 0);
+}
+
+//-----------------------------------------------------------------------------
+bool pattern_start(const plan_t *plan)
+{
+  int len = g_config.pattern_len;
+
+  if (0 == plan->per || plan->freq > PATTERN_MAX_FREQ)
+    return false;
+
+  // PATTB is copied to PATT on the update at the end of each period and the
+  // same overflow requests the next DMA beat, so the table starts two steps
+  // ahead of the output
+  for (int i = 0; i < len; i++)
+    g_buffer.pattern[i] = pattern_value(i + 2);
+
+  pwm_timer_init(pwm_timer_ctrla(plan->presc, plan->dith),
+      pwm_timer_top(plan->per, plan->dith), plan->cc, 0, 0);
+
+  TCC0->PATT.reg = pattern_value(0);
+  TCC0->PATTB.reg = pattern_value(1);
+
+  dma_loop(PATTERN_DMA_CH, TCC0_DMAC_ID_OVF, g_buffer.pattern, len,
+      sizeof(uint16_t), &TCC0->PATTB.reg);
+
+  TCC0->CTRLA.reg |= TCC_CTRLA_ENABLE;
+
+  generator_output(STEP_OUTPUT_TCC);
+  HAL_GPIO_FIN_pmuxen(PORT_PMUX_PMUXE_F_Val);
+
+  pattern_active = true;
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void pattern_stop(void)
+{
+  if (!pattern_active)
+    return;
+
+  dma_stop(PATTERN_DMA_CH);
+
+  pattern_active = false;
+}
+
+
@@ -0,0 +1,780 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+#include "config.h"
+#include "planner.h"
+#include "pll.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define XTAL_FREQ      12000000000
+
+#define RDIV_MIN       8
+#define RDIV_MAX       374 // Ensures 32 kHz - 1 MHz PLL input frequency range
+
+#define TIMER_MAX      (1 << 24)
+#define GENDIV_MAX     255
+
+#define LOW_JITTER_PPB 1000
+#define BALANCED_PPB   100
+
+#define LOCK_MARGIN_US 6000
+
+#define TCC_DIV_MIN    3     // Shortest period with duty control
+#define DUTY_PPB       1000  // Error allowed to keep the duty control
+
+#define DITHER_DIV_MIN TCC_DIV_MIN // Direct GCLK4 output is never dithered
+#define DITHER_PER_MAX 10000 // Longer periods already have 0.01% duty resolution
+
+#define LOCK_WEIGHT    1    // ppb per ms of predicted lock time
+#define NEAREST_STEPS  32   // Frequencies checked one by one before the divider search
+#define NEAREST_DIVS   32   // Dividers searched for the nearest exact frequency
+#define FAST_WEIGHT    1000
+
+#define PERIOD_REF     12   // 1 MHz reference, the highest the DPLL accepts
+
+/*- Constants ---------------------------------------------------------------*/
+const int planner_prescaler[PLANNER_PRESCALERS] = { 1, 2, 4, 8, 16, 64, 256, 1024 };
+
+/*- Variables ---------------------------------------------------------------*/
+static int64_t planner_xtal;
+static int64_t planner_target;
+static int64_t planner_dmin;
+static int64_t planner_dmax;
+static int64_t planner_k;
+static int64_t planner_dith;
+static int planner_presc;
+static int planner_gendiv;
+static int planner_weight;
+static int planner_active;
+static bool planner_shape;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+static void planner_split(int64_t div)
+{
+  planner_presc = 0;
+  planner_gendiv = 1;
+
+  // Dividers above the timer range are split between the GCLK4 divider, the
+  // TCC prescaler and the period, so only multiples of their product are used
+  while (div / (planner_prescaler[planner_presc] * planner_gendiv) > TIMER_MAX)
+  {
+    if (planner_presc < PLANNER_PRESCALERS - 1)
+      planner_presc++;
+    else if (planner_gendiv < GENDIV_MAX)
+      planner_gendiv++;
+    else
+      break;
+  }
+
+  planner_k = planner_prescaler[planner_presc] * planner_gendiv;
+}
+
+//-----------------------------------------------------------------------------
+static void planner_prepare(plan_t *plan, int64_t freq)
+{
+  int64_t dmin = (PLL_MIN_FREQ + freq - 1) / freq;
+  int64_t dmax = PLL_MAX_FREQ / freq;
+
+  if (dmax < dmin)
+    dmax = dmin;
+
+  planner_xtal = XTAL_FREQ + g_config.xtal_trim;
+  planner_target = freq;
+  planner_split(dmax);
+  planner_dmin = (dmin + planner_k - 1) / planner_k;
+  planner_dmax = dmax / planner_k;
+  planner_dith = 1;
+
+  planner_shape = false;
+  planner_weight = (CONFIG_RETUNE_FAST == g_config.retune) ? FAST_WEIGHT : LOCK_WEIGHT;
+  planner_active = pll_active_rdiv();
+
+  plan->error = INT64_MAX;
+  plan->cost = INT64_MAX;
+  plan->lock_time = INT32_MAX;
+  plan->ctrlb = SYSCTRL_DPLLCTRLB_LBYPASS;
+  plan->dith = false;
+}
+
+//-----------------------------------------------------------------------------
+static void planner_dither(void)
+{
+  // Dithered period alternates between two lengths, so it only adds to the
+  // frequency resolution where exact frequency is the objective
+  if (CONFIG_OBJECTIVE_EXACT != g_config.objective ||
+      planner_dmin < DITHER_DIV_MIN || planner_dmax > DITHER_PER_MAX)
+    return;
+
+  planner_dith = DITHER_STEPS;
+  planner_dmin *= DITHER_STEPS;
+  planner_dmax *= DITHER_STEPS;
+}
+
+//-----------------------------------------------------------------------------
+static int planner_lock_time(int rdiv)
+{
+  // Running DPLL only has to follow a ratio update
+  if (rdiv == planner_active)
+    return 0;
+
+  return pll_lock_predict(rdiv);
+}
+
+//-----------------------------------------------------------------------------
+static int64_t planner_penalty(int rdiv)
+{
+  return planner_target * planner_weight / 1000 * planner_lock_time(rdiv) / 1000000;
+}
+
+//-----------------------------------------------------------------------------
+static void planner_candidate(plan_t *plan, int rdiv, int64_t n, int64_t d)
+{
+  int64_t q = 16 * rdiv * planner_k;
+  int64_t m = (planner_dmin + d - 1) / d;
+  int64_t s = planner_dith;
+  int lock_time = planner_lock_time(rdiv);
+  int64_t error, cost;
+
+  if (0 == n || (d * m) > planner_dmax)
+    return;
+
+  // Whole count periods are not dithered, so they are used when possible
+  for (int64_t t = d; s > 1 && 0 == (t & 1); t /= 2)
+    s /= 2;
+
+  if (d * ((m + s - 1) / s * s) <= planner_dmax)
+    m = (m + s - 1) / s * s;
+
+  // Highest DPLL frequency gives the finest duty steps on short periods
+  if (planner_shape)
+    m = planner_dmax / d;
+
+  error = iabs(planner_target * q * d - planner_xtal * planner_dith * n) * 1000 / (q * d);
+  cost = error + planner_penalty(rdiv);
+
+  // Equal cost plans are ordered by the lock time
+  if (cost > plan->cost || (cost == plan->cost && lock_time >= plan->lock_time))
+    return;
+
+  n *= m;
+  d *= m;
+
+  plan->rdiv = rdiv;
+  plan->ldr = n / 16;
+  plan->ldrfrac = n % 16;
+  plan->per = d;
+  plan->pll_freq = planner_xtal * n / (16 * rdiv);
+  plan->freq = (planner_xtal * planner_dith * n + q * d / 2) / (q * d);
+  plan->error = error;
+  plan->cost = cost;
+  plan->lock_time = lock_time;
+}
+
+//-----------------------------------------------------------------------------
+static void planner_approximate(plan_t *plan, int rdiv, int step)
+{
+  int64_t num = planner_target * (16 / step) * rdiv * planner_k;
+  int64_t den = planner_xtal * planner_dith;
+  int64_t p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+  int64_t a, t;
+
+  // Walk the continued fraction of the required ratio, the best approximation
+  // with a denominator within the divider range is either the last convergent
+  // or the largest semiconvergent after it
+  while (den)
+  {
+    a = num / den;
+
+    if (q1 && a > (planner_dmax - q0) / q1)
+    {
+      a = (planner_dmax - q0) / q1;
+      planner_candidate(plan, rdiv, (p0 + a * p1) * step, q0 + a * q1);
+      break;
+    }
+
+    t = p0 + a * p1;
+    p0 = p1;
+    p1 = t;
+
+    t = q0 + a * q1;
+    q0 = q1;
+    q1 = t;
+
+    planner_candidate(plan, rdiv, p1 * step, q1);
+
+    t = num - a * den;
+    num = den;
+    den = t;
+  }
+}
+
+//-----------------------------------------------------------------------------
+static bool planner_scan(plan_t *plan, int step, int64_t tolerance)
+{
+  // Retuning the running DPLL is the cheapest option, so it sets the bound
+  if (planner_active)
+    planner_approximate(plan, planner_active, step);
+
+  // Reference dividers are scanned from the highest reference frequency down,
+  // so the first plan within the tolerance also has the fastest PLL loop
+  for (int rdiv = RDIV_MIN; rdiv <= RDIV_MAX; rdiv += 2)
+  {
+    // Lock time alone already costs more than the best plan so far
+    if (rdiv == planner_active || planner_penalty(rdiv) > plan->cost)
+      continue;
+
+    planner_approximate(plan, rdiv, step);
+
+    if (plan->error <= tolerance)
+      return true;
+  }
+
+  return plan->error <= tolerance;
+}
+
+//-----------------------------------------------------------------------------
+static void planner_finish(plan_t *plan, int dc)
+{
+  int64_t div = plan->per * planner_k / planner_dith;
+
+  // Short periods get the duty resolution from compare dithering
+  if (1 == planner_dith && div >= DITHER_DIV_MIN && plan->per <= DITHER_PER_MAX &&
+      CONFIG_OBJECTIVE_LOW_JITTER != g_config.objective)
+  {
+    plan->per *= DITHER_STEPS;
+    planner_dith = DITHER_STEPS;
+  }
+
+  plan->dith = (planner_dith > 1);
+
+  if (div <= 2)
+  {
+    plan->gendiv = div;
+    plan->presc = 0;
+    plan->per = 0;
+    plan->cc = 0;
+
+    if (dc < 3333)
+      plan->dc = 0;
+    else if (dc > 6666)
+      plan->dc = 10000;
+    else
+      plan->dc = 5000;
+
+    plan->dc_step = 5000;
+  }
+  else
+  {
+    plan->gendiv = planner_gendiv;
+    plan->presc = planner_presc;
+    plan->cc = ((int64_t)dc * plan->per + 5000) / 10000;
+    plan->dc = ((int64_t)plan->cc * 10000 + plan->per / 2) / plan->per;
+    plan->dc_step = (10000 + plan->per - 1) / plan->per;
+  }
+}
+
+//-----------------------------------------------------------------------------
+static void planner_loop(plan_t *plan)
+{
+  const pll_stats_t *stats = pll_stats(plan->rdiv);
+  int filter, ltime;
+  int ctrlb = SYSCTRL_DPLLCTRLB_LBYPASS;
+
+  if (plan->rdiv == planner_active &&
+      (CONFIG_OBJECTIVE_EXACT == g_config.objective || CONFIG_RETUNE_FAST == g_config.retune))
+  {
+    // Keep the running loop settings, so only the ratio has to be updated
+    plan->ctrlb = pll_active_ctrlb();
+    return;
+  }
+
+  if (CONFIG_OBJECTIVE_LOW_JITTER == g_config.objective)
+  {
+    // Keep the output gated until the loop is locked, so no off-frequency
+    // edges appear while it settles
+    filter = SYSCTRL_DPLLCTRLB_FILTER_HBFILT_Val;
+    ctrlb = 0;
+  }
+  else if (CONFIG_OBJECTIVE_BALANCED == g_config.objective)
+  {
+    // Wide loop tracks the clean crystal reference on integer ratios, narrow
+    // loop attenuates fractional-N spurs
+    filter = plan->ldrfrac ? SYSCTRL_DPLLCTRLB_FILTER_LBFILT_Val : SYSCTRL_DPLLCTRLB_FILTER_HBFILT_Val;
+  }
+  else
+  {
+    // Use whichever of the default and the wide loop locked faster at this
+    // reference frequency, settings not measured yet are tried first
+    filter = SYSCTRL_DPLLCTRLB_FILTER_DEFAULT_Val;
+
+    if (pll_lock_time(plan->rdiv, SYSCTRL_DPLLCTRLB_FILTER_HBFILT_Val) <
+        pll_lock_time(plan->rdiv, SYSCTRL_DPLLCTRLB_FILTER_DEFAULT_Val))
+      filter = SYSCTRL_DPLLCTRLB_FILTER_HBFILT_Val;
+  }
+
+  // Time-out has to cover the slowest lock seen at this reference frequency,
+  // low reference frequencies start with the longest one
+  if (stats->timeouts || stats->lock_max > LOCK_MARGIN_US)
+    ltime = SYSCTRL_DPLLCTRLB_LTIME_11MS_Val;
+  else if (stats->locks || plan->rdiv <= 48) // 250 kHz and above
+    ltime = SYSCTRL_DPLLCTRLB_LTIME_8MS_Val;
+  else
+    ltime = SYSCTRL_DPLLCTRLB_LTIME_11MS_Val;
+
+  plan->ctrlb = ctrlb | SYSCTRL_DPLLCTRLB_FILTER(filter) | SYSCTRL_DPLLCTRLB_LTIME(ltime);
+}
+
+#ifdef WITH_STATS
+//-----------------------------------------------------------------------------
+static void planner_legacy_scan(plan_t *plan)
+{
+  int64_t pll_freq = planner_target;
+  int64_t div = 1;
+  int64_t min_rem = INT64_MAX;
+  int64_t min_step = 1;
+  int min_rdiv = RDIV_MIN;
+  bool min_high = false;
+  int64_t pll_div;
+
+  while (pll_freq < PLL_MIN_FREQ)
+  {
+    pll_freq *= 2;
+    div *= 2;
+  }
+
+  for (int rdiv = RDIV_MIN; rdiv <= RDIV_MAX; rdiv += 2)
+  {
+    int64_t ref = planner_xtal / rdiv;
+    int64_t step = ref / 16;
+    int64_t rem = pll_freq % step;
+
+    if (rem < min_rem)
+    {
+      min_rem = rem;
+      min_rdiv = rdiv;
+      min_step = step;
+      min_high = false;
+    }
+
+    if ((step - rem) < min_rem)
+    {
+      min_rem = step - rem;
+      min_rdiv = rdiv;
+      min_step = step;
+      min_high = true;
+    }
+
+    if (0 == rem)
+      break;
+  }
+
+  pll_div = pll_freq / min_step;
+
+  if (min_high)
+    pll_div += 1;
+
+  planner_candidate(plan, min_rdiv, pll_div, div / planner_k * planner_dith);
+}
+
+//-----------------------------------------------------------------------------
+void planner_legacy(plan_t *plan, int64_t freq, int dc)
+{
+  planner_prepare(plan, freq);
+  planner_legacy_scan(plan);
+  planner_finish(plan, dc);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+void planner_fixed(plan_t *plan, int64_t freq, int dc, int rdiv, int ctrlb)
+{
+  // Reference divider and loop settings are shared by all steps of a
+  // sequence, so the steps only differ in the ratio and the output dividers
+  planner_prepare(plan, freq);
+  planner_dither();
+  planner_approximate(plan, rdiv, 1);
+  planner_finish(plan, dc);
+  plan->ctrlb = ctrlb;
+}
+
+//-----------------------------------------------------------------------------
+void planner_period(plan_t *plan, int period, int dc)
+{
+  int64_t div;
+
+  // Periods too long for a frequency in mHz are counted at the lowest DPLL
+  // frequency. With the reference at the crystal divided by PERIOD_REF it is
+  // an integer ratio with no fractional part, so every period is a whole
+  // number of DPLL cycles locked to the crystal. Only the dividers are planned.
+  planner_xtal = XTAL_FREQ + g_config.xtal_trim;
+  planner_dith = 1;
+  planner_active = pll_active_rdiv();
+
+  plan->rdiv = PERIOD_REF;
+  plan->ldr = PLL_MIN_FREQ * PERIOD_REF / XTAL_FREQ; // 48 MHz
+  plan->ldrfrac = 0;
+  plan->pll_freq = planner_xtal * plan->ldr / plan->rdiv;
+  plan->lock_time = planner_lock_time(plan->rdiv);
+
+  div = ((int64_t)period * plan->pll_freq + 500000) / 1000000;
+
+  planner_split(div);
+  plan->per = (div + planner_k / 2) / planner_k;
+  plan->freq = (plan->pll_freq + plan->per * planner_k / 2) / (plan->per * planner_k);
+  plan->error = iabs((int64_t)period * plan->pll_freq - plan->per * planner_k * 1000000) *
+      1000 / period / (plan->per * planner_k);
+  plan->cost = plan->error;
+
+  planner_finish(plan, dc);
+  planner_loop(plan);
+}
+
+//-----------------------------------------------------------------------------
+static uint64_t planner_gcd(uint64_t a, uint64_t b)
+{
+  int shift = __builtin_ctzll(a | b);
+
+  // Binary GCD, there is no hardware divider
+  a >>= __builtin_ctzll(a);
+
+  while (b)
+  {
+    uint64_t t;
+
+    b >>= __builtin_ctzll(b);
+
+    if (a > b)
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+
+    b -= a;
+  }
+
+  return a << shift;
+}
+
+//-----------------------------------------------------------------------------
+static bool planner_exact(plan_t *plan, int64_t freq)
+{
+  int64_t g, p, q;
+
+  // Neighbours may cross a divider boundary, so the limits are their own
+  planner_prepare(plan, freq);
+
+  g = planner_gcd(16 * freq, planner_xtal);
+  p = 16 * freq / g;
+  q = planner_xtal / g;
+
+  // Exact plans have ratio / (rdiv * div) = p / q, so the ratio is p * t and
+  // rdiv * div is q * t. The DPLL range bounds t and the divider has to be a
+  // multiple of the prescaler and GCLK4 divider product.
+  for (int rdiv = RDIV_MIN; rdiv <= RDIV_MAX; rdiv += 2)
+  {
+    int64_t n_min = (PLL_MIN_FREQ * 16 * rdiv + planner_xtal - 1) / planner_xtal;
+    int64_t n_max = PLL_MAX_FREQ * 16 * rdiv / planner_xtal;
+    int64_t k = rdiv * planner_k;
+    int64_t step = k / planner_gcd(k, q);
+    int64_t t = ((n_min + p - 1) / p + step - 1) / step * step;
+
+    if (t * p <= n_max && q * t / k <= planner_dmax)
+      return true;
+  }
+
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+int64_t planner_nearest(int64_t freq, int dir)
+{
+  plan_t plan;
+  int64_t best = 0;
+  int64_t dmax;
+
+  // Low frequencies have exact neighbours close by
+  for (int i = 1; i <= NEAREST_STEPS && freq + dir * i > 0; i++)
+  {
+    if (planner_exact(&plan, freq + dir * i))
+      return freq + dir * i;
+  }
+
+  planner_prepare(&plan, freq);
+  dmax = planner_dmax;
+
+  if (dmax > planner_dmin + NEAREST_DIVS - 1)
+    dmax = planner_dmin + NEAREST_DIVS - 1;
+
+  // For a given reference and output divider the DPLL ratio steps by one,
+  // so the exact frequencies are multiples of xtal / gcd(xtal, 16 * rdiv * div).
+  // The nearest multiple in the search direction is taken from every pair.
+  for (int rdiv = RDIV_MIN; rdiv <= RDIV_MAX; rdiv += 2)
+  {
+    for (int64_t d = planner_dmin; d <= dmax; d++)
+    {
+      int64_t div = d * planner_k;
+      int64_t step = planner_xtal / planner_gcd(planner_xtal, 16 * rdiv * div);
+      int64_t f;
+
+      if (dir > 0)
+        f = (freq / step + 1) * step;
+      else
+        f = ((freq - 1) / step) * step;
+
+      // Direct output above the DPLL range is allowed, like in the planner
+      if (f <= 0 || f * div < PLL_MIN_FREQ || (f * div > PLL_MAX_FREQ && div > 1))
+        continue;
+
+      if (0 == best || (dir > 0 && f < best) || (dir < 0 && f > best))
+        best = f;
+    }
+  }
+
+  // Nothing exact in this direction, the frequency stays where it is
+  if (0 == best)
+    return freq;
+
+  return best;
+}
+
+//-----------------------------------------------------------------------------
+void planner_pack(step_t *step, const plan_t *plan)
+{
+  step->per = plan->per;
+  step->cc = plan->cc;
+  step->ratio = plan->ldr * 16 + plan->ldrfrac;
+  step->gendiv = plan->gendiv;
+  step->presc = plan->presc;
+  step->dith = plan->dith;
+
+  if (0 == plan->dc)
+    step->output = STEP_OUTPUT_LOW;
+  else if (10000 == plan->dc)
+    step->output = STEP_OUTPUT_HIGH;
+  else if (0 == plan->per)
+    step->output = STEP_OUTPUT_GCLK;
+  else
+    step->output = STEP_OUTPUT_TCC;
+}
+
+//-----------------------------------------------------------------------------
+static void planner_run(plan_t *plan)
+{
+  bool found = false;
+  int64_t freq = planner_target;
+
+  // Integer ratios avoid fractional-N spurs, they are accepted as long as
+  // the error stays within the objective tolerance
+  if (CONFIG_OBJECTIVE_LOW_JITTER == g_config.objective)
+  {
+    planner_scan(plan, 16, freq * LOW_JITTER_PPB / 1000000);
+    found = (plan->error < INT64_MAX);
+  }
+  else if (CONFIG_OBJECTIVE_BALANCED == g_config.objective)
+  {
+    found = planner_scan(plan, 16, freq * BALANCED_PPB / 1000000);
+  }
+
+  // The first reference divider scanned gives the initial error bound
+  if (!found)
+    planner_scan(plan, 1, 0);
+}
+
+//-----------------------------------------------------------------------------
+void planner_search(plan_t *plan, int64_t freq, int dc)
+{
+  planner_prepare(plan, freq);
+  planner_dither();
+  planner_run(plan);
+
+  // Direct GCLK4 output is fixed at 50% duty, other duty cycles need the DPLL
+  // at a higher multiple of the output frequency and TCC0 with a short period
+  if (dc > 0 && dc < 10000 && dc != 5000 && plan->per * planner_k <= 2 &&
+      planner_dmax >= TCC_DIV_MIN)
+  {
+    plan_t direct = *plan;
+
+    planner_dmin = TCC_DIV_MIN;
+    planner_shape = true;
+    plan->error = INT64_MAX;
+    plan->cost = INT64_MAX;
+    plan->lock_time = INT32_MAX;
+    planner_run(plan);
+
+    if (plan->cost > direct.cost + freq * DUTY_PPB / 1000000)
+      *plan = direct;
+  }
+
+  planner_finish(plan, dc);
+  planner_loop(plan);
+}
+
+//-----------------------------------------------------------------------------
+bool planner_direct(plan_t *plan, int64_t freq, int dc)
+{
+  plan_t dpll = *plan;
+  int64_t div;
+
+  // DFLL48M runs open loop without the USB SOF reference, so the crystal is
+  // the only source accurate enough to replace the DPLL
+  planner_xtal = XTAL_FREQ + g_config.xtal_trim;
+
+  if (planner_xtal % freq)
+    return false;
+
+  div = planner_xtal / freq;
+  planner_dith = 1;
+  planner_split(div);
+
+  if (div % planner_k)
+    return false;
+
+  // Direct GCLK4 output would lose the duty control of a shaped DPLL plan
+  if (div <= 2 && plan->per && dc > 0 && dc < 10000 && dc != 5000)
+    return false;
+
+  plan->rdiv = 0;
+  plan->ldr = 0;
+  plan->ldrfrac = 0;
+  plan->ctrlb = 0;
+  plan->per = div / planner_k;
+  plan->pll_freq = planner_xtal;
+  plan->freq = freq;
+  plan->error = 0;
+  plan->cost = 0;
+  plan->lock_time = 0;
+
+  planner_finish(plan, dc);
+
+  // Dithered compare or a coarser duty would trade the DPLL jitter for
+  // the TCC jitter or a duty error, the DPLL plan is kept in that case
+  if ((plan->dith && (plan->cc % DITHER_STEPS)) || iabs(plan->dc - dc) > iabs(dpll.dc - dc))
+  {
+    *plan = dpll;
+    return false;
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+int planner_joint(plan_t *plan, int64_t freq, int64_t freq_b)
+{
+  int64_t dmin = (PLL_MIN_FREQ + freq - 1) / freq;
+  int64_t dmax = PLL_MAX_FREQ / freq;
+  int64_t best = INT64_MAX;
+  int64_t error_b;
+  int div = 1, div_b = 1;
+
+  if (dmax > GENDIV_MAX)
+    dmax = GENDIV_MAX;
+
+  // Both outputs are integer divisions of the shared DPLL frequency, the
+  // dividers with the smallest mismatch between the two are used
+  for (int64_t d = dmin; d <= dmax; d++)
+  {
+    int64_t pll_freq = freq * d;
+    int64_t d_b = (pll_freq + freq_b / 2) / freq_b;
+    int64_t mismatch;
+
+    if (d_b < 1 || d_b > GENDIV_MAX)
+      continue;
+
+    mismatch = iabs(pll_freq - freq_b * d_b) * 1000000 / pll_freq;
+
+    if (mismatch < best)
+    {
+      best = mismatch;
+      div = d;
+      div_b = d_b;
+    }
+  }
+
+  // No DPLL frequency divides down to both outputs
+  if (INT64_MAX == best)
+    return 0;
+
+  // DPLL is set half way between the two, so the relative error is split
+  // between the outputs
+  planner_prepare(plan, (freq * div + freq_b * div_b) / 2);
+  planner_dmin = 1;
+  planner_dmax = 1;
+  planner_run(plan);
+  planner_loop(plan);
+
+  plan->gendiv = div;
+  plan->presc = 0;
+  plan->per = 0;
+  plan->cc = 0;
+  plan->dc = 5000;
+  plan->dc_step = 5000;
+  plan->freq = (plan->pll_freq + div / 2) / div;
+
+  // Reported error is the worse of the two outputs
+  plan->error = iabs(plan->freq - freq) * 1000;
+  error_b = iabs((plan->pll_freq + div_b / 2) / div_b - freq_b) * 1000;
+
+  if (error_b > plan->error)
+    plan->error = error_b;
+
+  return div_b;
+}
+
+//-----------------------------------------------------------------------------
+int planner_average(const plan_t *plan, int64_t freq, int *frac)
+{
+  int64_t xtal = XTAL_FREQ + g_config.xtal_trim;
+  int64_t num = freq * 16 * plan->rdiv;
+  int64_t den = xtal;
+
+  // Ratio in 1/16 steps that gives the exact frequency with the dividers of
+  // the plan, split into the integer ratio and a 16 bit fraction
+  if (plan->per)
+  {
+    num *= (int64_t)plan->per * plan->gendiv * planner_prescaler[plan->presc];
+    den *= plan->dith ? DITHER_STEPS : 1;
+  }
+  else
+  {
+    num *= plan->gendiv ? plan->gendiv : 1;
+  }
+
+  num += den / (2 * 65536); // Rounded to the nearest fraction step
+  *frac = (num % den) * 65536 / den;
+
+  return num / den;
+}
+
+
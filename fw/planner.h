@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PLANNER_H_
+#define _PLANNER_H_
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*- Definitions -------------------------------------------------------------*/
+#define DITHER_STEPS   64 // TCC0 DITH6 resolution extension
+#define PLANNER_PRESCALERS 8  // TCC and TC prescaler settings
+
+#define PLL_MIN_FREQ   48000000000
+#define PLL_MAX_FREQ   96000000000
+
+#define JOINT_MIN_FREQ 188235295 // 48 MHz / 255
+#define JOINT_MAX_FREQ 96000000000
+
+#define PERIOD_MIN_MS  1
+#define PERIOD_MAX_MS  90000000 // 25 hours, the longest 48 MHz divider
+
+enum
+{
+  STEP_OUTPUT_GCLK,
+  STEP_OUTPUT_TCC,
+  STEP_OUTPUT_LOW,
+  STEP_OUTPUT_HIGH,
+};
+
+/*- Types -------------------------------------------------------------------*/
+typedef struct
+{
+  int      rdiv;      // DPLL reference divider, XOSC / rdiv, 0 if XOSC drives GCLK4
+  int      ldr;       // DPLL ratio, integer part
+  int      ldrfrac;   // DPLL ratio, fractional part in 1/16 steps
+  int      ctrlb;     // DPLL loop filter and lock settings
+  int      gendiv;    // GCLK4 divider
+  int      presc;     // TCC0 prescaler selection
+  int      per;       // TCC0 period in counts, 0 if GCLK4 drives FOUT directly
+  int      cc;        // TCC0 compare value
+  bool     dith;      // Period and compare are in 1/DITHER_STEPS counts
+  int      dc;        // Resulting duty cycle
+  int      dc_step;   // Duty cycle granularity
+  int64_t  pll_freq;  // DPLL output frequency
+  int64_t  freq;      // Resulting output frequency
+  int64_t  error;     // Absolute frequency error, uHz
+  int64_t  cost;      // Error plus lock time penalty, uHz
+  int      lock_time; // Predicted DPLL lock time, us
+} plan_t;
+
+// Resolved plan reduced to the register values, so it can be applied from
+// an interrupt without running the planner
+typedef struct
+{
+  uint32_t dwell;      // Step duration, sequencer timer ticks
+  uint32_t per;        // TCC0 period in counts
+  uint32_t cc;         // TCC0 compare value
+  uint16_t ratio;      // DPLL ratio in 1/16 steps, 0 if GCLK4 runs from XOSC
+  uint8_t  gendiv;     // GCLK4 divider
+  uint8_t  presc  : 3; // TCC0 prescaler selection
+  uint8_t  dith   : 1; // TCC0 dithering enabled
+  uint8_t  output : 4; // Output source, STEP_OUTPUT_*
+} step_t;
+
+/*- Variables ---------------------------------------------------------------*/
+extern const int planner_prescaler[PLANNER_PRESCALERS];
+
+/*- Prototypes --------------------------------------------------------------*/
+void planner_search(plan_t *plan, int64_t freq, int dc);
+void planner_legacy(plan_t *plan, int64_t freq, int dc);
+void planner_fixed(plan_t *plan, int64_t freq, int dc, int rdiv, int ctrlb);
+void planner_period(plan_t *plan, int period, int dc);
+int64_t planner_nearest(int64_t freq, int dir);
+void planner_pack(step_t *step, const plan_t *plan);
+bool planner_direct(plan_t *plan, int64_t freq, int dc);
+int planner_joint(plan_t *plan, int64_t freq, int64_t freq_b);
+int planner_average(const plan_t *plan, int64_t freq, int *frac);
+
+#endif // _PLANNER_H_
+
+
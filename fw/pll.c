@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "globals.h"
+#include "config.h"
+#include "pll.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define LOCK_CYCLES    40 // Typical lock time in reference clock cycles
+#define LTIME_GCLK     3  // 32 kHz clock of the lock timeout timer
+#define RATIO_DROP_US  100 // Two reference cycles at the lowest reference
+
+/*- Constants ---------------------------------------------------------------*/
+static const int pll_init_rdiv[] = { 8, 24, 96, 374 };
+static const pll_stats_t pll_no_stats;
+
+/*- Variables ---------------------------------------------------------------*/
+static int pll_rdiv = 0;
+static int pll_ctrlb = 0;
+static int pll_lock_us[PLL_SLOTS][4];
+static pll_stats_t pll_slots[PLL_SLOTS];
+static int pll_slot_next = 0;
+static int pll_timeout_cnt = 0;
+static int pll_retune_cnt = 0;
+static int pll_unlock_time = -1;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+void pll_init(void)
+{
+  // The lock timeout counts the 32 kHz clock, without it DPLLLTO never fires
+  GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(LTIME_GCLK) | GCLK_GENCTRL_SRC_OSCULP32K |
+      GCLK_GENCTRL_RUNSTDBY | GCLK_GENCTRL_GENEN;
+  while (GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY);
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_FDPLL32K | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(LTIME_GCLK);
+
+  // Lock once at a few reference frequencies, so the planner starts with
+  // measured lock times
+  for (int i = 0; i < (int)(sizeof(pll_init_rdiv) / sizeof(int)); i++)
+  {
+    pll_set(pll_init_rdiv[i], pll_init_rdiv[i] * 4, 0, SYSCTRL_DPLLCTRLB_LBYPASS |
+        SYSCTRL_DPLLCTRLB_LTIME(SYSCTRL_DPLLCTRLB_LTIME_11MS_Val)); // 48 MHz
+  }
+
+  SYSCTRL->DPLLCTRLA.reg = 0;
+}
+
+//-----------------------------------------------------------------------------
+int pll_active_rdiv(void)
+{
+  if (SYSCTRL->DPLLCTRLA.reg & SYSCTRL_DPLLCTRLA_ENABLE)
+    return pll_rdiv;
+
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+int pll_active_ctrlb(void)
+{
+  return pll_ctrlb;
+}
+
+//-----------------------------------------------------------------------------
+static int pll_find(int rdiv)
+{
+  for (int i = 0; i < PLL_SLOTS; i++)
+  {
+    if (rdiv == pll_slots[i].rdiv)
+      return i;
+  }
+
+  return -1;
+}
+
+//-----------------------------------------------------------------------------
+static int pll_slot(int rdiv)
+{
+  int slot = pll_find(rdiv);
+
+  if (slot < 0)
+  {
+    // There are more reference dividers than slots, the one that got its
+    // slot first gives it up first
+    slot = pll_slot_next;
+    pll_slot_next = (pll_slot_next + 1) % PLL_SLOTS;
+
+    pll_slots[slot] = pll_no_stats;
+    pll_slots[slot].rdiv = rdiv;
+
+    for (int i = 0; i < 4; i++)
+      pll_lock_us[slot][i] = 0;
+  }
+
+  return slot;
+}
+
+//-----------------------------------------------------------------------------
+int pll_lock_time(int rdiv, int filter)
+{
+  int slot = pll_find(rdiv);
+
+  return (slot < 0) ? 0 : pll_lock_us[slot][filter];
+}
+
+//-----------------------------------------------------------------------------
+int pll_lock_predict(int rdiv)
+{
+  const pll_stats_t *stats = pll_stats(rdiv);
+
+  if (stats->locks)
+    return stats->lock_avg;
+
+  return LOCK_CYCLES * rdiv / 12; // 12 MHz XOSC
+}
+
+//-----------------------------------------------------------------------------
+const pll_stats_t *pll_stats(int rdiv)
+{
+  int slot = pll_find(rdiv);
+
+  return (slot < 0) ? &pll_no_stats : &pll_slots[slot];
+}
+
+//-----------------------------------------------------------------------------
+const pll_stats_t *pll_slot_stats(int slot)
+{
+  return &pll_slots[slot];
+}
+
+//-----------------------------------------------------------------------------
+int pll_timeouts(void)
+{
+  return pll_timeout_cnt;
+}
+
+//-----------------------------------------------------------------------------
+int pll_retunes(void)
+{
+  return pll_retune_cnt;
+}
+
+//-----------------------------------------------------------------------------
+int pll_last_unlock(void)
+{
+  return pll_unlock_time;
+}
+
+//-----------------------------------------------------------------------------
+static void pll_update_stats(pll_stats_t *stats, int ready, int lock)
+{
+  stats->locks++;
+
+  if (1 == stats->locks)
+  {
+    stats->ready_min = stats->ready_avg = stats->ready_max = ready;
+    stats->lock_min = stats->lock_avg = stats->lock_max = lock;
+    return;
+  }
+
+  if (ready < stats->ready_min)
+    stats->ready_min = ready;
+
+  if (ready > stats->ready_max)
+    stats->ready_max = ready;
+
+  if (lock < stats->lock_min)
+    stats->lock_min = lock;
+
+  if (lock > stats->lock_max)
+    stats->lock_max = lock;
+
+  stats->ready_avg += (ready - stats->ready_avg) / stats->locks;
+  stats->lock_avg += (lock - stats->lock_avg) / stats->locks;
+}
+
+//-----------------------------------------------------------------------------
+void pll_set(int rdiv, int ldr, int ldrfrac, int ctrlb)
+{
+  int filter = (ctrlb & SYSCTRL_DPLLCTRLB_FILTER_Msk) >> SYSCTRL_DPLLCTRLB_FILTER_Pos;
+  bool relock = true;
+  bool timeout = false;
+  int ready = -1;
+  uint32_t start;
+  int time;
+
+  SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLTO;
+
+  if (rdiv == pll_active_rdiv() && ctrlb == pll_ctrlb)
+  {
+    // The ratio may be changed while the DPLL is running, the loop only has
+    // to track the frequency step and the output is not interrupted
+    start = get_system_time_us();
+    SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDR(ldr - 1) | SYSCTRL_DPLLRATIO_LDRFRAC(ldrfrac);
+    relock = false;
+
+    // LOCK still belongs to the old ratio until the new one is applied on
+    // a reference edge, so wait for it to drop before waiting for the lock.
+    // A step small enough to stay inside the lock window never drops it.
+    while ((SYSCTRL->DPLLSTATUS.reg & SYSCTRL_DPLLSTATUS_LOCK) &&
+        (int)(get_system_time_us() - start) < RATIO_DROP_US);
+  }
+  else
+  {
+    SYSCTRL->DPLLCTRLA.reg = 0;
+    SYSCTRL->DPLLCTRLB.reg = SYSCTRL_DPLLCTRLB_REFCLK_REF1 | ctrlb |
+        SYSCTRL_DPLLCTRLB_DIV(rdiv / 2 - 1);
+    SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDR(ldr - 1) | SYSCTRL_DPLLRATIO_LDRFRAC(ldrfrac);
+
+    start = get_system_time_us();
+    SYSCTRL->DPLLCTRLA.reg = SYSCTRL_DPLLCTRLA_ENABLE | SYSCTRL_DPLLCTRLA_RUNSTDBY;
+  }
+
+  while (1)
+  {
+    int status = SYSCTRL->DPLLSTATUS.reg;
+
+    time = get_system_time_us() - start;
+
+    if (ready < 0 && (status & SYSCTRL_DPLLSTATUS_CLKRDY))
+      ready = time;
+
+    if (ready >= 0 && (status & SYSCTRL_DPLLSTATUS_LOCK))
+      break;
+
+    if (SYSCTRL->INTFLAG.reg & SYSCTRL_INTFLAG_DPLLLTO)
+    {
+      timeout = true;
+      break;
+    }
+  }
+
+  // Only full re-locks are representative for the filter selection and
+  // the lock statistics
+  if (!relock)
+  {
+    pll_retune_cnt++;
+  }
+  else if (timeout)
+  {
+    pll_slots[pll_slot(rdiv)].timeouts++;
+    pll_timeout_cnt++;
+  }
+  else
+  {
+    int slot = pll_slot(rdiv);
+    int *lock_us = &pll_lock_us[slot][filter];
+
+    *lock_us = *lock_us ? (*lock_us * 3 + time) / 4 : time;
+    pll_update_stats(&pll_slots[slot], ready, time);
+  }
+
+  pll_rdiv = rdiv;
+  pll_ctrlb = ctrlb;
+
+  SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLCKF;
+}
+
+//-----------------------------------------------------------------------------
+void pll_retune(int ratio)
+{
+  // Safe to call from an interrupt, the loop follows the new ratio on its own
+  // and nothing is waited for
+  SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDR(ratio / 16 - 1) |
+      SYSCTRL_DPLLRATIO_LDRFRAC(ratio % 16);
+
+  pll_retune_cnt++;
+}
+
+//-----------------------------------------------------------------------------
+void pll_modulate(int ratio)
+{
+  // Same as a retune, but the averaging modulator updates the ratio at a
+  // fixed rate, so it is not counted in the statistics
+  SYSCTRL->DPLLRATIO.reg = SYSCTRL_DPLLRATIO_LDR(ratio / 16 - 1) |
+      SYSCTRL_DPLLRATIO_LDRFRAC(ratio % 16);
+}
+
+//-----------------------------------------------------------------------------
+bool pll_unlocked(void)
+{
+  if (0 == (SYSCTRL->INTFLAG.reg & SYSCTRL_INTFLAG_DPLLLCKF))
+    return false;
+
+  SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_DPLLLCKF;
+
+  g_config.pll_unlocks++;
+  pll_unlock_time = get_system_time();
+
+  return true;
+}
+
+
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PLL_H_
+#define _PLL_H_
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+
+/*- Definitions -------------------------------------------------------------*/
+#define PLL_SLOTS      8 // Reference dividers with their own lock statistics
+
+/*- Types -------------------------------------------------------------------*/
+typedef struct
+{
+  int      rdiv;        // Reference divider, 0 for an unused slot
+  int      locks;
+  int      timeouts;
+  int      ready_min;   // Request to CLKRDY, us
+  int      ready_avg;
+  int      ready_max;
+  int      lock_min;    // Request to LOCK, us
+  int      lock_avg;
+  int      lock_max;
+} pll_stats_t;
+
+/*- Prototypes --------------------------------------------------------------*/
+void pll_init(void);
+void pll_set(int rdiv, int ldr, int ldrfrac, int ctrlb);
+void pll_retune(int ratio);
+void pll_modulate(int ratio);
+bool pll_unlocked(void);
+int pll_active_rdiv(void);
+int pll_active_ctrlb(void);
+int pll_lock_time(int rdiv, int filter);
+int pll_lock_predict(int rdiv);
+const pll_stats_t *pll_stats(int rdiv);
+const pll_stats_t *pll_slot_stats(int slot);
+int pll_timeouts(void);
+int pll_retunes(void);
+int pll_last_unlock(void);
+
+#endif // _PLL_H_
+
+
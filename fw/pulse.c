@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "samd11.h"
+#include "hal_gpio.h"
+#include "globals.h"
+#include "config.h"
+#include "planner.h"
+#include "generator.h"
+#include "dma.h"
+#include "pulse.h"
+
+/*- Definitions -------------------------------------------------------------*/
+HAL_GPIO_PIN(FIN,      A, 15)
+
+#define STOP_LATENCY_NS  200 // Resynchronized event path through TC2
+#define DELAY_RATIO      (100 * 16) // 100 MHz from 12 MHz / 12
+
+#define TRAIN_ENTRIES    ((const train_entry_t *)CONFIG_TRAIN_OFFSET)
+#define TRAIN_PER_DMA_CH 0
+#define TRAIN_CC_DMA_CH  1
+
+_Static_assert(sizeof(train_entry_t) * TRAIN_MAX_STEPS <= CONFIG_ROW_SIZE, "Train is too big");
+_Static_assert(sizeof(generator_buffer_t) == sizeof(step_t) * SEQUENCE_MAX_STEPS,
+    "Train does not fit into the generator buffer");
+
+/*- Constants ---------------------------------------------------------------*/
+static const int burst_prescaler[] =
+{
+  TC_CTRLA_PRESCALER_DIV16_Val,
+  TC_CTRLA_PRESCALER_DIV16_Val,
+  TC_CTRLA_PRESCALER_DIV256_Val,
+  TC_CTRLA_PRESCALER_DIV1024_Val,
+};
+
+static const int burst_ticks[] = { 3000, 30000, 18750, 46875 }; // 1 ms - 1 s
+
+
+/*- Variables ---------------------------------------------------------------*/
+static bool pulse_active = false;
+static bool pulse_dma = false;
+static int pulse_trigger;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+static void pulse_trigger_init(int gclk)
+{
+  if (CONFIG_TRIGGER_PERIOD == pulse_trigger)
+  {
+    EVSYS->USER.reg = EVSYS_USER_USER(0x04/*TCC0_EV0*/) | EVSYS_USER_CHANNEL(2+1);
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(2) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS |
+        EVSYS_CHANNEL_EDGSEL_RISING_EDGE | EVSYS_CHANNEL_EVGEN(0x1f/*TC1 OVF*/);
+
+    TC1->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ |
+        TC_CTRLA_PRESCALER(burst_prescaler[g_config.burst_period]) |
+        TC_CTRLA_PRESCSYNC_PRESC;
+
+    TC1->COUNT16.COUNT.reg = 0;
+    TC1->COUNT16.CC[0].reg = burst_ticks[g_config.burst_period] - 1;
+    TC1->COUNT16.EVCTRL.reg = TC_EVCTRL_OVFEO;
+    TC1->COUNT16.CTRLA.bit.ENABLE = 1;
+  }
+  else if (CONFIG_TRIGGER_FIN == pulse_trigger)
+  {
+    EVSYS->USER.reg = EVSYS_USER_USER(0x04/*TCC0_EV0*/) | EVSYS_USER_CHANNEL(2+1);
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(2) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS |
+        EVSYS_CHANNEL_EDGSEL_RISING_EDGE | EVSYS_CHANNEL_EVGEN(0x0d/*EIC_EXTINT1*/);
+
+    PM->APBAMASK.reg |= PM_APBAMASK_EIC;
+
+    HAL_GPIO_FIN_in();
+    HAL_GPIO_FIN_pmuxen(PORT_PMUX_PMUXE_A_Val);
+
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EIC | GCLK_CLKCTRL_CLKEN |
+        GCLK_CLKCTRL_GEN(gclk);
+
+    EIC->CONFIG[0].reg = EIC_CONFIG_SENSE1_RISE;
+    EIC->EVCTRL.reg = EIC_EVCTRL_EXTINTEO1;
+    EIC->CTRL.bit.ENABLE = 1;
+  }
+}
+
+//-----------------------------------------------------------------------------
+bool pulse_burst(const plan_t *plan)
+{
+  int64_t low_ns;
+
+  if (0 == plan->per || 0 == plan->cc || plan->cc >= plan->per)
+    return false;
+
+  // The last falling edge stops TCC0 through TC2, this has to happen before
+  // the next period starts
+  low_ns = 1000000000000 / plan->freq * (plan->per - plan->cc) / plan->per;
+
+  if (low_ns < STOP_LATENCY_NS)
+    return false;
+
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS | PM_APBCMASK_TC1 | PM_APBCMASK_TC2;
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TC1_TC2 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(0);
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EVSYS_0 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(4);
+
+  EVSYS->CTRL.reg = EVSYS_CTRL_GCLKREQ;
+
+  // Every falling edge of the output is counted by TC2, it wraps after
+  // the last pulse of the burst and its overflow stops TCC0
+  EVSYS->USER.reg = EVSYS_USER_USER(0x0b/*TC2_EVU*/) | EVSYS_USER_CHANNEL(0+1);
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(0) | EVSYS_CHANNEL_PATH_RESYNCHRONIZED |
+      EVSYS_CHANNEL_EDGSEL_RISING_EDGE | EVSYS_CHANNEL_EVGEN(0x1b/*TCC0 MC0*/);
+
+  EVSYS->USER.reg = EVSYS_USER_USER(0x05/*TCC0_EV1*/) | EVSYS_USER_CHANNEL(1+1);
+  EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(1) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS |
+      EVSYS_CHANNEL_EDGSEL_RISING_EDGE | EVSYS_CHANNEL_EVGEN(0x22/*TC2 OVF*/);
+
+  TC2->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ;
+  TC2->COUNT16.COUNT.reg = 0;
+  TC2->COUNT16.CC[0].reg = g_config.burst_count - 1;
+  TC2->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_COUNT | TC_EVCTRL_OVFEO;
+  TC2->COUNT16.CTRLA.bit.ENABLE = 1;
+
+  pulse_trigger = g_config.burst_trigger;
+  pulse_trigger_init(0);
+  pulse_active = true;
+
+  // First burst starts with the timer, later ones on the retrigger
+  generator_output(STEP_OUTPUT_TCC);
+  pwm_timer_set(pwm_timer_ctrla(plan->presc, plan->dith), pwm_timer_top(plan->per, plan->dith),
+      plan->cc, 0, TCC_EVCTRL_EVACT0_RETRIGGER |
+      TCC_EVCTRL_TCEI0 | TCC_EVCTRL_EVACT1_STOP | TCC_EVCTRL_TCEI1 | TCC_EVCTRL_MCEO0);
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+static void pulse_clock(void)
+{
+  step_t step = { .ratio = DELAY_RATIO, .gendiv = 1, .output = STEP_OUTPUT_LOW };
+
+  // TCC0 runs directly from the 100 MHz GCLK4, one count is 10 ns
+  generator_apply(12, SYSCTRL_DPLLCTRLB_LBYPASS |
+      SYSCTRL_DPLLCTRLB_LTIME(SYSCTRL_DPLLCTRLB_LTIME_8MS_Val), &step);
+}
+
+//-----------------------------------------------------------------------------
+void pulse_delay(void)
+{
+  int cc = g_config.delay_ns / PULSE_STEP_NS; // Rounded down to the timer resolution
+  int per = cc + g_config.width_ns / PULSE_STEP_NS;
+
+  pulse_clock();
+
+  PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EVSYS_0 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(4);
+
+  // Inverted PWM keeps the output low until CC and high until the end of
+  // the period, the one-shot timer then stops and holds the low level
+  pwm_timer_set(TCC_CTRLA_PRESCALER_DIV1, per - 1, cc, TCC_WAVE_POL0,
+      TCC_EVCTRL_EVACT0_RETRIGGER | TCC_EVCTRL_TCEI0);
+
+  TCC0->CTRLBSET.reg = TCC_CTRLBSET_ONESHOT;
+  while (TCC0->SYNCBUSY.bit.CTRLB);
+
+  while (0 == TCC0->STATUS.bit.STOP);
+
+  generator_output(STEP_OUTPUT_TCC);
+
+  // EIC edge detection runs from the same 100 MHz clock and the event goes
+  // straight to TCC0, so the delay jitter is a few counts at most
+  pulse_trigger = CONFIG_TRIGGER_FIN;
+  pulse_trigger_init(4);
+  pulse_active = true;
+}
+
+//-----------------------------------------------------------------------------
+static int train_entry(int pos, int size, bool loop, int *offset)
+{
+  int index = 0;
+
+  // Entry and the repetition within it for a position in the train, the
+  // terminating entry follows the last one in a single pass
+  while (index < size && pos >= g_buffer.train.repeat[index])
+  {
+    pos -= g_buffer.train.repeat[index++];
+
+    if (loop && index == size)
+      index = 0;
+  }
+
+  *offset = (index < size) ? pos : 0;
+
+  return index;
+}
+
+//-----------------------------------------------------------------------------
+int pulse_train_size(void)
+{
+  int size = 0;
+
+  while (size < TRAIN_MAX_STEPS && TRAIN_ENTRIES[size].period >= TRAIN_MIN_NS &&
+      TRAIN_ENTRIES[size].period <= TRAIN_MAX_NS && TRAIN_ENTRIES[size].repeat > 0)
+    size++;
+
+  return size;
+}
+
+//-----------------------------------------------------------------------------
+void pulse_train_load(int index, train_entry_t *entry)
+{
+  *entry = TRAIN_ENTRIES[index];
+
+  // Erased entry
+  if (entry->period < TRAIN_MIN_NS || entry->period > TRAIN_MAX_NS)
+  {
+    entry->period = 1000000;
+    entry->width = 500000;
+    entry->repeat = 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+void pulse_train_store(int index, const train_entry_t *entry)
+{
+  train_entry_t entries[TRAIN_MAX_STEPS];
+
+  // Running train is streamed from RAM, so the flash write does not stop it
+  memcpy(entries, TRAIN_ENTRIES, sizeof(entries));
+  entries[index] = *entry;
+  config_write_row(CONFIG_TRAIN_OFFSET, entries, sizeof(entries));
+}
+
+//-----------------------------------------------------------------------------
+bool pulse_train(void)
+{
+  int size = pulse_train_size();
+  bool loop = (CONFIG_REPEAT_LOOP == g_config.list_repeat);
+  int max_per = 0;
+  int presc = 0;
+  int index, offset;
+
+  if (0 == size)
+    return false;
+
+  for (int i = 0; i < size; i++)
+  {
+    if (TRAIN_ENTRIES[i].period > max_per)
+      max_per = TRAIN_ENTRIES[i].period;
+  }
+
+  // All entries share the timer clock, so the longest period sets it
+  while (max_per / PULSE_STEP_NS / planner_prescaler[presc] >= (1 << 24))
+    presc++;
+
+  for (int i = 0; i < size; i++)
+  {
+    const train_entry_t *entry = &TRAIN_ENTRIES[i];
+    int step = PULSE_STEP_NS * planner_prescaler[presc];
+    int per = (entry->period + step / 2) / step;
+    int cc = (entry->width + step / 2) / step;
+
+    g_buffer.train.value[0][i] = per - 1;
+    g_buffer.train.value[1][i] = (cc < per) ? cc : per;
+    g_buffer.train.repeat[i] = (entry->repeat > TRAIN_MAX_REPEAT) ? TRAIN_MAX_REPEAT : entry->repeat;
+  }
+
+  // Single pass ends with the output held low
+  g_buffer.train.value[0][size] = g_buffer.train.value[0][size - 1];
+  g_buffer.train.value[1][size] = 0;
+  g_buffer.train.repeat[size] = 1;
+
+  pulse_clock();
+
+  // Each overflow loads the buffered period and compare and requests the
+  // next pair, so the DMA stream starts with the third period of the train.
+  // Entries are repeated by the block count without the source increment.
+  for (int ch = 0; ch < 2; ch++)
+  {
+    for (int i = 0; i <= size; i++)
+    {
+      DmacDescriptor *desc = &g_buffer.train.desc[ch][i];
+      int next = (i < size - 1 || (i == size - 1 && !loop)) ? (i + 1) : 0;
+
+      desc->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_WORD;
+      desc->BTCNT.reg = g_buffer.train.repeat[i];
+      desc->SRCADDR.reg = (uint32_t)&g_buffer.train.value[ch][i];
+      desc->DSTADDR.reg = ch ? (uint32_t)&TCC0->CCB[0].reg : (uint32_t)&TCC0->PERB.reg;
+      desc->DESCADDR.reg = (i == size) ? 0 : (uint32_t)&g_buffer.train.desc[ch][next];
+    }
+
+    index = train_entry(2, size, loop, &offset);
+    *dma_descriptor(ch) = g_buffer.train.desc[ch][index];
+    dma_descriptor(ch)->BTCNT.reg -= offset;
+  }
+
+  index = train_entry(0, size, loop, &offset);
+  pwm_timer_init(TCC_CTRLA_PRESCALER(presc), g_buffer.train.value[0][index], g_buffer.train.value[1][index], 0, 0);
+
+  index = train_entry(1, size, loop, &offset);
+  TCC0->PERB.reg = g_buffer.train.value[0][index];
+  TCC0->CCB[0].reg = g_buffer.train.value[1][index];
+
+  dma_start(TRAIN_PER_DMA_CH, TCC0_DMAC_ID_OVF);
+  dma_start(TRAIN_CC_DMA_CH, TCC0_DMAC_ID_OVF);
+
+  TCC0->CTRLA.reg |= TCC_CTRLA_ENABLE;
+  generator_output(STEP_OUTPUT_TCC);
+
+  pulse_dma = true;
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void pulse_fire(void)
+{
+  TCC0->CTRLBSET.reg = TCC_CTRLBSET_CMD_RETRIGGER;
+}
+
+//-----------------------------------------------------------------------------
+void pulse_stop(void)
+{
+  if (pulse_dma)
+  {
+    dma_stop(TRAIN_PER_DMA_CH);
+    dma_stop(TRAIN_CC_DMA_CH);
+    pulse_dma = false;
+  }
+
+  if (!pulse_active)
+    return;
+
+  TC1->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC1->COUNT16.CTRLA.bit.SWRST);
+
+  TC2->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC2->COUNT16.CTRLA.bit.SWRST);
+
+  EVSYS->CTRL.reg = EVSYS_CTRL_SWRST;
+
+  if (CONFIG_TRIGGER_FIN == pulse_trigger)
+  {
+    EIC->CTRL.reg = EIC_CTRL_SWRST;
+    while (EIC->STATUS.bit.SYNCBUSY);
+
+    HAL_GPIO_FIN_pmuxdis();
+  }
+
+  pulse_active = false;
+}
+
+
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PULSE_H_
+#define _PULSE_H_
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "planner.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define BURST_MAX_COUNT     65535
+#define PULSE_STEP_NS       10
+#define PULSE_MAX_NS        (PULSE_STEP_NS * 0xffffff)
+
+// Entries fill one flash row, their DMA descriptors and values take 44 B
+// each and have to fit into the 1 KB buffer shared with the sweep steps
+#define TRAIN_MAX_STEPS     21
+#define TRAIN_MIN_NS        1000 // Two DMA beats have to fit into a period
+#define TRAIN_MAX_NS        999999990
+#define TRAIN_MAX_REPEAT    65535
+
+/*- Types -------------------------------------------------------------------*/
+typedef struct
+{
+  int      period; // ns
+  int      width;  // High time, ns
+  int      repeat; // Periods, 0 ends the train
+} train_entry_t;
+
+/*- Prototypes --------------------------------------------------------------*/
+bool pulse_burst(const plan_t *plan);
+void pulse_delay(void);
+bool pulse_train(void);
+int pulse_train_size(void);
+void pulse_train_load(int index, train_entry_t *entry);
+void pulse_train_store(int index, const train_entry_t *entry);
+void pulse_fire(void);
+void pulse_stop(void);
+
+#endif // _PULSE_H_
+
+
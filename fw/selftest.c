@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "ssd1306.h"
+#include "globals.h"
+#include "buttons.h"
+#include "config.h"
+#include "planner.h"
+#include "pll.h"
+#include "generator.h"
+#include "meter.h"
+#include "selftest.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define SETTLE_MS      100  // Output settling time before the measurement
+#define ERROR_PPB      1000 // Allowed error on top of the one count resolution
+#define ERROR_COUNT    1000 // One count in a 1 s gate, mHz
+
+enum
+{
+  RESULT_PENDING,
+  RESULT_OK,
+  RESULT_ERROR,
+  RESULT_LOCK,
+};
+
+/*- Types -------------------------------------------------------------------*/
+typedef struct
+{
+  int64_t  freq;
+  int      result;
+} selftest_result_t;
+
+/*- Constants ---------------------------------------------------------------*/
+// Edges are counted at the 48 MHz system clock, so the list stays well below
+// half of that. None of them is an exact division of the crystal, so all of
+// them go through the DPLL.
+static const int64_t selftest_freq[] =
+{
+  115200000,   // 115.2 kHz
+  1843200000,  // 1.8432 MHz
+  3579545000,  // 3.579545 MHz
+  4096000000,  // 4.096 MHz
+  10000000000, // 10 MHz
+  12288000000, // 12.288 MHz
+  14318180000, // 14.31818 MHz
+  20000000000, // 20 MHz
+};
+
+#define SELFTEST_SIZE  (int)(sizeof(selftest_freq) / sizeof(selftest_freq[0]))
+
+static const char *result_str[] =
+{
+  "RUN ",
+  "OK  ",
+  "ERR ",
+  "LOCK",
+};
+
+/*- Variables ---------------------------------------------------------------*/
+static selftest_result_t selftest_results[SELFTEST_SIZE];
+static int selftest_index;
+static int selftest_page;
+static int selftest_timeouts;
+static int selftest_unlocks;
+static int selftest_settle_time;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+static void update_display(void)
+{
+  const selftest_result_t *res = &selftest_results[selftest_page];
+  int64_t freq = selftest_freq[selftest_page];
+
+  oled_set_font(SMALL);
+
+  oled_print(0, 0, "F");
+  oled_print(1, 0, "Mea");
+  oled_print(2, 0, "Err");
+
+  print_freq(0, 18, -1, freq);
+  print_freq(1, 18, -1, res->freq);
+  print_freq_sign(2, 42, -1, res->freq ? res->freq - freq : 0);
+
+  oled_print(0, 110, "Hz");
+  oled_print(1, 110, "Hz");
+  oled_print(2, 110, "Hz");
+
+  oled_print(3, 0, "TEST  /");
+  print_count(3, 30, -1, 1, selftest_page + 1);
+  print_count(3, 42, -1, 1, SELFTEST_SIZE);
+  oled_print(3, 60, (char *)result_str[res->result]);
+}
+
+//-----------------------------------------------------------------------------
+static void selftest_next(void)
+{
+  plan_t plan;
+  step_t step;
+
+  selftest_results[selftest_index].freq = 0;
+  selftest_results[selftest_index].result = RESULT_PENDING;
+
+  // Same plan as the continuous output would use for this frequency
+  planner_search(&plan, selftest_freq[selftest_index], 5000);
+  planner_direct(&plan, selftest_freq[selftest_index], 5000);
+  planner_pack(&step, &plan);
+
+  selftest_timeouts = pll_timeouts();
+  pll_unlocked();
+
+  generator_apply(plan.rdiv, plan.ctrlb, &step);
+
+  selftest_settle_time = get_system_time() + SETTLE_MS;
+}
+
+//-----------------------------------------------------------------------------
+void selftest_enable(void)
+{
+  generator_clocks();
+  meter_start();
+
+  selftest_index = 0;
+  selftest_page = 0;
+
+  for (int i = 0; i < SELFTEST_SIZE; i++)
+    selftest_results[i].result = RESULT_PENDING;
+
+  selftest_next();
+  update_display();
+}
+
+//-----------------------------------------------------------------------------
+void selftest_disable(void)
+{
+  meter_stop();
+  generator_disable();
+}
+
+//-----------------------------------------------------------------------------
+void selftest_buttons_event(int button, int event, int interval)
+{
+  if (BUTTON_PRESSED == event && BUTTON_CENTER == button)
+    return set_menu_mode();
+
+  if (BUTTON_PRESSED != event && BUTTON_REPEAT != event)
+    return;
+
+  if (BUTTON_UP == button && selftest_page > 0)
+    selftest_page--;
+  else if (BUTTON_DOWN == button && selftest_page < SELFTEST_SIZE - 1)
+    selftest_page++;
+
+  update_display();
+
+  (void)interval;
+}
+
+//-----------------------------------------------------------------------------
+void selftest_task(void)
+{
+  selftest_result_t *res;
+  int64_t freq, limit;
+
+  update_pll_lock_indicator();
+
+  if (selftest_index == SELFTEST_SIZE)
+    return;
+
+  if (selftest_settle_time)
+  {
+    if (get_system_time() < selftest_settle_time)
+      return;
+
+    selftest_settle_time = 0;
+    selftest_unlocks = g_config.pll_unlocks;
+    meter_arm();
+  }
+
+  if (!meter_read(&freq))
+    return;
+
+  res = &selftest_results[selftest_index];
+  limit = selftest_freq[selftest_index] / 1000000 * ERROR_PPB / 1000 + ERROR_COUNT;
+
+  res->freq = freq;
+
+  // Time-outs while locking and lost locks during the gate are both failures
+  // of the DPLL, regardless of the measured frequency. The lock indicator
+  // clears the unlock flag, so the unlock count is compared instead.
+  if (pll_timeouts() != selftest_timeouts || g_config.pll_unlocks != selftest_unlocks)
+    res->result = RESULT_LOCK;
+  else if (iabs(freq - selftest_freq[selftest_index]) > limit)
+    res->result = RESULT_ERROR;
+  else
+    res->result = RESULT_OK;
+
+  // Follow the test until it is done, then stay on the last entry
+  selftest_page = selftest_index;
+  selftest_index++;
+
+  if (selftest_index < SELFTEST_SIZE)
+    selftest_next();
+
+  update_display();
+}
+
+
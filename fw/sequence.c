@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "samd11.h"
+#include "hal_gpio.h"
+#include "globals.h"
+#include "config.h"
+#include "planner.h"
+#include "generator.h"
+#include "pll.h"
+#include "sequence.h"
+
+/*- Definitions -------------------------------------------------------------*/
+HAL_GPIO_PIN(SYNC,     A, 15) // Shared with the counter input
+
+#define LOG2_FRAC      16
+
+#define LIST_MAGIC     0x7473694c
+#define LIST_ENTRIES   ((const list_entry_t *)CONFIG_LIST_OFFSET)
+#define LIST_PLAN      ((const list_plan_t *)(CONFIG_LIST_OFFSET + CONFIG_ROW_SIZE))
+
+/*- Types -------------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  int      rdiv;
+  int      ctrlb;
+  int      xtal_trim;
+  step_t   step[LIST_MAX_STEPS];
+} list_plan_t;
+
+_Static_assert(sizeof(list_entry_t) * LIST_MAX_STEPS <= CONFIG_ROW_SIZE, "List is too big");
+_Static_assert(sizeof(list_plan_t) <= CONFIG_ROW_SIZE, "List plan is too big");
+
+/*- Constants ---------------------------------------------------------------*/
+static const int sweep_steps[] = { 8, 16, 32, 64 };
+static const int sweep_dwell[] = { 1, 10, 100, 1000 };
+static const int list_repeat[] = { 0, 1, 10, 100 };
+
+static const uint32_t exp2_table[LOG2_FRAC] =
+{
+  0x5a82799a, 0x4c1bf829, 0x45cae0f2, 0x42d561b4, // 2^(1/2) .. 2^(1/16), Q30
+  0x4166c34c, 0x40b268fa, 0x4058f6a8, 0x402c6be9,
+  0x4016321b, 0x400b1818, 0x40058bce, 0x4002c5d8,
+  0x400162e8, 0x4000b173, 0x400058b9, 0x40002c5d,
+};
+
+/*- Variables ---------------------------------------------------------------*/
+static const step_t *sequence_steps;
+static volatile int sequence_size = 0;
+static volatile int sequence_index;
+static int sequence_passes;
+static bool sequence_marker;
+static volatile int sequence_ratio;
+static volatile int sequence_frac = 0;
+static int sequence_acc;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+static int sequence_log2(int64_t value)
+{
+  int exp = 63 - __builtin_clzll(value);
+  uint64_t x = (exp > 30) ? (value >> (exp - 30)) : (value << (30 - exp));
+  int res = exp << LOG2_FRAC;
+
+  for (int bit = 1 << (LOG2_FRAC - 1); bit; bit >>= 1)
+  {
+    x = (x * x) >> 30;
+
+    if (x >= (2ull << 30))
+    {
+      x >>= 1;
+      res |= bit;
+    }
+  }
+
+  return res;
+}
+
+//-----------------------------------------------------------------------------
+static int64_t sequence_exp2(int value)
+{
+  int exp = value >> LOG2_FRAC;
+  uint64_t x = 1 << 30;
+
+  for (int i = 0; i < LOG2_FRAC; i++)
+  {
+    if (value & (1 << (LOG2_FRAC - 1 - i)))
+      x = (x * exp2_table[i]) >> 30;
+  }
+
+  if (exp >= 30)
+    return x << (exp - 30);
+
+  return (x + (1 << (29 - exp))) >> (30 - exp);
+}
+
+//-----------------------------------------------------------------------------
+static int64_t sequence_sweep_freq(int index, int steps)
+{
+  int64_t start = g_config.freq;
+  int64_t stop = g_config.sweep_stop;
+  int lstart, lstop;
+
+  if (0 == index)
+    return start;
+  else if (index == (steps - 1))
+    return stop;
+
+  if (CONFIG_GEN_SWEEP_LIN == g_config.gen_mode)
+    return start + (stop - start) * index / (steps - 1);
+
+  // Logarithmic points are interpolated in the log2 domain, the 16 bit
+  // fraction keeps them within 20 ppm of the ideal position
+  lstart = sequence_log2(start);
+  lstop = sequence_log2(stop);
+
+  return sequence_exp2(lstart + (lstop - lstart) * index / (steps - 1));
+}
+
+//-----------------------------------------------------------------------------
+static void sequence_point(int index, int size, plan_t *plan, int rdiv, int ctrlb)
+{
+  int64_t freq;
+  int dc;
+
+  if (CONFIG_GEN_LIST == g_config.gen_mode)
+  {
+    freq = LIST_ENTRIES[index].freq;
+    dc = LIST_ENTRIES[index].dc;
+  }
+  else
+  {
+    freq = sequence_sweep_freq(index, size);
+    dc = g_config.dc;
+  }
+
+  // Reference divider is not selected yet
+  if (0 == rdiv)
+    planner_search(plan, freq, dc);
+  else
+    planner_fixed(plan, freq, dc, rdiv, ctrlb);
+}
+
+//-----------------------------------------------------------------------------
+static int64_t sequence_build(step_t *steps, int size, int rdiv, int ctrlb)
+{
+  int64_t error = 0;
+  plan_t plan;
+
+  for (int i = 0; i < size; i++)
+  {
+    sequence_point(i, size, &plan, rdiv, ctrlb);
+    planner_pack(&steps[i], &plan);
+
+    if (CONFIG_GEN_LIST == g_config.gen_mode)
+      steps[i].dwell = (uint32_t)LIST_ENTRIES[i].dwell * SEQUENCE_TICKS_MS;
+    else
+      steps[i].dwell = sweep_dwell[g_config.sweep_dwell] * SEQUENCE_TICKS_MS;
+
+    error += plan.error / (plan.freq / 1000000 + 1); // ppb
+  }
+
+  return error;
+}
+
+//-----------------------------------------------------------------------------
+static void sequence_resolve(step_t *steps, int size, int *rdiv, int *ctrlb)
+{
+  int64_t min_error = INT64_MAX;
+  plan_t plan;
+
+  // All steps share one reference divider, so a step is only a ratio update
+  // of the running DPLL. The divider is taken from the best plan at the start,
+  // the middle or the end of the sequence, whichever fits all the points best.
+  for (int i = 0; i < 3; i++)
+  {
+    int64_t error;
+
+    sequence_point(i * (size - 1) / 2, size, &plan, 0, 0);
+    error = sequence_build(steps, size, plan.rdiv, plan.ctrlb);
+
+    if (error < min_error)
+    {
+      min_error = error;
+      *rdiv = plan.rdiv;
+      *ctrlb = plan.ctrlb;
+    }
+  }
+
+  sequence_build(steps, size, *rdiv, *ctrlb);
+}
+
+//-----------------------------------------------------------------------------
+int sequence_list_size(void)
+{
+  int size = 0;
+
+  while (size < LIST_MAX_STEPS && LIST_ENTRIES[size].freq > 0 &&
+      LIST_ENTRIES[size].dwell > 0)
+    size++;
+
+  return size;
+}
+
+//-----------------------------------------------------------------------------
+static void sequence_list_resolve(void)
+{
+  list_plan_t plan;
+  int size = sequence_list_size();
+
+  plan.magic = LIST_MAGIC;
+  plan.rdiv = 0;
+  plan.ctrlb = 0;
+  plan.xtal_trim = g_config.xtal_trim;
+
+  if (size)
+    sequence_resolve(plan.step, size, &plan.rdiv, &plan.ctrlb);
+
+  config_write_row(CONFIG_LIST_OFFSET + CONFIG_ROW_SIZE, &plan, sizeof(list_plan_t));
+}
+
+//-----------------------------------------------------------------------------
+void sequence_list_load(int index, list_entry_t *entry)
+{
+  *entry = LIST_ENTRIES[index];
+
+  // Erased entry
+  if (entry->freq <= 0)
+  {
+    entry->freq = 1 * kHz;
+    entry->dc = 5000;
+    entry->dwell = 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+void sequence_list_store(int index, const list_entry_t *entry)
+{
+  list_entry_t entries[LIST_MAX_STEPS];
+
+  sequence_stop();
+
+  memcpy(entries, LIST_ENTRIES, sizeof(entries));
+  entries[index] = *entry;
+  config_write_row(CONFIG_LIST_OFFSET, entries, sizeof(entries));
+
+  // Plans are resolved once here, so starting the list does not take any
+  // planner runs or DPLL re-locks between the steps
+  sequence_list_resolve();
+}
+
+//-----------------------------------------------------------------------------
+static void sequence_timer_start(int ticks)
+{
+  PM->APBCMASK.reg |= PM_APBCMASK_TC1 | PM_APBCMASK_TC2;
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TC1_TC2 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(0);
+
+  TC1->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_WAVEGEN_MFRQ |
+      TC_CTRLA_PRESCALER_DIV16 | TC_CTRLA_PRESCSYNC_PRESC;
+
+  TC1->COUNT32.COUNT.reg = 0;
+  TC1->COUNT32.CC[0].reg = ticks - 1;
+  TC1->COUNT32.INTENSET.reg = TC_INTENSET_OVF;
+  NVIC_EnableIRQ(TC1_IRQn);
+
+  TC1->COUNT32.CTRLA.bit.ENABLE = 1;
+}
+
+//-----------------------------------------------------------------------------
+static void sequence_start(const step_t *steps, int size, int passes, bool marker)
+{
+  sequence_steps = steps;
+  sequence_index = 0;
+  sequence_size = size;
+  sequence_passes = passes;
+  sequence_marker = marker;
+
+  if (marker)
+  {
+    HAL_GPIO_SYNC_out();
+    HAL_GPIO_SYNC_set();
+  }
+
+  sequence_timer_start(steps[0].dwell);
+}
+
+//-----------------------------------------------------------------------------
+void sequence_average(int ratio, int frac)
+{
+  // First order sigma-delta modulation between two adjacent ratios, the
+  // DPLL loop filters the steps and the average ratio is ratio + frac / 2^16
+  sequence_ratio = ratio;
+  sequence_frac = frac;
+  sequence_acc = 0;
+  sequence_marker = false;
+
+  sequence_timer_start(AVERAGE_TICKS);
+}
+
+//-----------------------------------------------------------------------------
+bool sequence_run(void)
+{
+  const step_t *steps = g_buffer.steps;
+  int size, rdiv, ctrlb, passes = 0;
+
+  if (CONFIG_GEN_LIST == g_config.gen_mode)
+  {
+    size = sequence_list_size();
+
+    if (0 == size)
+      return false;
+
+    if (LIST_MAGIC != LIST_PLAN->magic || g_config.xtal_trim != LIST_PLAN->xtal_trim)
+      sequence_list_resolve();
+
+    steps = LIST_PLAN->step;
+    rdiv = LIST_PLAN->rdiv;
+    ctrlb = LIST_PLAN->ctrlb;
+    passes = list_repeat[g_config.list_repeat];
+  }
+  else
+  {
+    size = sweep_steps[g_config.sweep_steps];
+    sequence_resolve(g_buffer.steps, size, &rdiv, &ctrlb);
+  }
+
+  generator_apply(rdiv, ctrlb, &steps[0]);
+  sequence_start(steps, size, passes, g_config.sweep_marker);
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void sequence_stop(void)
+{
+  if (0 == sequence_size && 0 == sequence_frac)
+    return;
+
+  NVIC_DisableIRQ(TC1_IRQn);
+
+  TC1->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC1->COUNT32.STATUS.bit.SYNCBUSY);
+  while (TC1->COUNT32.CTRLA.bit.SWRST);
+
+  if (sequence_marker)
+  {
+    HAL_GPIO_SYNC_clr();
+    HAL_GPIO_SYNC_in();
+  }
+
+  sequence_size = 0;
+  sequence_frac = 0;
+}
+
+//-----------------------------------------------------------------------------
+void irq_handler_tc1(void)
+{
+  const step_t *step;
+
+  TC1->COUNT32.INTFLAG.reg = TC_INTFLAG_OVF;
+
+  if (sequence_frac)
+  {
+    sequence_acc += sequence_frac;
+    pll_modulate(sequence_ratio + (sequence_acc >> 16));
+    sequence_acc &= 0xffff;
+    return;
+  }
+
+  if (++sequence_index == sequence_size)
+  {
+    // Last pass keeps the output at the final step
+    if (sequence_passes && 0 == --sequence_passes)
+    {
+      TC1->COUNT32.CTRLA.bit.ENABLE = 0;
+      return;
+    }
+
+    sequence_index = 0;
+  }
+
+  step = &sequence_steps[sequence_index];
+
+  generator_step(step);
+  TC1->COUNT32.CC[0].reg = step->dwell - 1;
+
+  if (sequence_marker)
+    HAL_GPIO_SYNC_write(0 == sequence_index);
+}
+
+
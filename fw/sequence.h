@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SEQUENCE_H_
+#define _SEQUENCE_H_
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "planner.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define SEQUENCE_MAX_STEPS  64
+#define SEQUENCE_TICKS_MS   3000 // 48 MHz / 16
+#define AVERAGE_TICKS       300 // 10 kHz ratio update rate
+
+#define LIST_MAX_STEPS      15
+#define LIST_DWELL_MAX      1000000 // ms
+
+/*- Types -------------------------------------------------------------------*/
+typedef struct
+{
+  int64_t  freq;
+  int      dc;     // 0 for the output off
+  int      dwell;  // ms, 0 ends the list
+} list_entry_t;
+
+/*- Prototypes --------------------------------------------------------------*/
+bool sequence_run(void);
+void sequence_stop(void);
+void sequence_average(int ratio, int frac);
+int sequence_list_size(void);
+void sequence_list_load(int index, list_entry_t *entry);
+void sequence_list_store(int index, const list_entry_t *entry);
+
+#endif // _SEQUENCE_H_
+
+
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2017, Alex Taradov <alex@taradov.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*- Includes ----------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdbool.h>
+#include "samd11.h"
+#include "globals.h"
+#include "config.h"
+#include "planner.h"
+#include "dma.h"
+#include "generator.h"
+#include "spread.h"
+
+/*- Definitions -------------------------------------------------------------*/
+#define SPREAD_DMA_CH    0
+#define SPREAD_CLOCK     48000 // kHz, GCLK0
+#define SPREAD_MIN_STEPS 8
+#define SPREAD_MIN_TICKS 16 // Limits the DMA beat rate to 3 MHz
+#define SPREAD_LEVELS    8  // Ratio steps per side at the lowest DPLL frequency
+#define SPREAD_RDIV_MIN  8
+#define SPREAD_RDIV_MAX  374 // 32 kHz DPLL reference
+#define XTAL_FREQ        12000000000
+
+// Wide loop follows the modulation, the lock time-out covers the low
+// reference frequencies
+#define SPREAD_CTRLB     (SYSCTRL_DPLLCTRLB_FILTER_HBFILT | SYSCTRL_DPLLCTRLB_LBYPASS | \
+    SYSCTRL_DPLLCTRLB_LTIME(SYSCTRL_DPLLCTRLB_LTIME_11MS_Val))
+
+/*- Variables ---------------------------------------------------------------*/
+static bool spread_active = false;
+
+/*- Implementations ---------------------------------------------------------*/
+
+//-----------------------------------------------------------------------------
+static int spread_steps(int rate, int *ticks)
+{
+  int best = -1, steps = 0;
+
+  // Steps per modulation period and the step interval, the most steps
+  // within 1% of the requested rate win
+  for (int n = SPREAD_MAX_STEPS; n >= SPREAD_MIN_STEPS; n -= 2)
+  {
+    int t = (SPREAD_CLOCK + n * rate / 2) / (n * rate);
+    int error;
+
+    if (t < SPREAD_MIN_TICKS)
+      continue;
+
+    error = SPREAD_CLOCK * 1000 / (n * t) - rate * 1000;
+    error = (error < 0) ? -error : error;
+
+    if (best < 0 || error < best)
+    {
+      best = error;
+      steps = n;
+      *ticks = t;
+    }
+
+    if (error <= rate * 10)
+      break;
+  }
+
+  return steps;
+}
+
+//-----------------------------------------------------------------------------
+void spread_plan(plan_t *plan, int64_t freq, int dc)
+{
+  int64_t rdiv;
+
+  // A 1/16 ratio step is xtal / (16 * rdiv), the reference is lowered until
+  // the deviation spans enough steps to be modulated at all. A higher
+  // reference keeps the loop fast enough to follow the profile.
+  rdiv = ((int64_t)SPREAD_LEVELS * XTAL_FREQ * 10000 + 16 * PLL_MIN_FREQ * g_config.spread - 1) /
+      (16 * PLL_MIN_FREQ * g_config.spread);
+  rdiv = (rdiv + 1) & ~1;
+
+  if (rdiv < SPREAD_RDIV_MIN)
+    rdiv = SPREAD_RDIV_MIN;
+  else if (rdiv > SPREAD_RDIV_MAX)
+    rdiv = SPREAD_RDIV_MAX;
+
+  planner_fixed(plan, freq, dc, rdiv, SPREAD_CTRLB);
+}
+
+//-----------------------------------------------------------------------------
+bool spread_start(const plan_t *plan)
+{
+  int64_t ratio = plan->ldr * 16 + plan->ldrfrac;
+  int64_t min = (ratio * PLL_MIN_FREQ + plan->pll_freq - 1) / plan->pll_freq;
+  int64_t max = ratio * PLL_MAX_FREQ / plan->pll_freq;
+  int64_t spread = ratio * g_config.spread;
+  int ticks = SPREAD_MIN_TICKS;
+  uint32_t changes = 0;
+  int steps, half;
+
+  steps = spread_steps(g_config.spread_rate, &ticks);
+  half = steps / 2;
+
+  // Triangular profile of DPLL ratios, either +/-spread around the planned
+  // ratio or down to -spread below it. Steps outside of the DPLL range are
+  // clamped.
+  for (int i = 0; i < steps; i++)
+  {
+    int pos = (i < half) ? i : (steps - i);
+    int64_t value;
+
+    if (CONFIG_SPREAD_DOWN == g_config.spread_profile)
+      value = (ratio * half * 10000 + spread * (pos - half) + half * 5000) / (half * 10000);
+    else
+      value = (ratio * half * 10000 + spread * (pos * 2 - half) + half * 5000) / (half * 10000);
+
+    if (value < min)
+      value = min;
+    else if (value > max)
+      value = max;
+
+    g_buffer.spread[i] = SYSCTRL_DPLLRATIO_LDR(value / 16 - 1) | SYSCTRL_DPLLRATIO_LDRFRAC(value % 16);
+    changes |= g_buffer.spread[i] ^ g_buffer.spread[0];
+  }
+
+  // Whole profile rounded to a single ratio, nothing would be modulated
+  if (0 == changes)
+    return false;
+
+  // The DMA writes the ratio on every TC1 overflow, the DPLL follows without
+  // relocking and no CPU time is used
+  PM->APBCMASK.reg |= PM_APBCMASK_TC1;
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_TC1_TC2 | GCLK_CLKCTRL_CLKEN |
+      GCLK_CLKCTRL_GEN(0);
+
+  TC1->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ;
+  TC1->COUNT16.COUNT.reg = 0;
+  TC1->COUNT16.CC[0].reg = ticks - 1;
+
+  dma_loop(SPREAD_DMA_CH, TC1_DMAC_ID_OVF, g_buffer.spread, steps,
+      sizeof(uint32_t), &SYSCTRL->DPLLRATIO.reg);
+
+  TC1->COUNT16.CTRLA.bit.ENABLE = 1;
+
+  spread_active = true;
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void spread_stop(void)
+{
+  if (!spread_active)
+    return;
+
+  TC1->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  while (TC1->COUNT16.STATUS.bit.SYNCBUSY);
+  while (TC1->COUNT16.CTRLA.bit.SWRST);
+
+  dma_stop(SPREAD_DMA_CH);
+
+  spread_active = false;
+}
+
+